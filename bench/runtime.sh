@@ -0,0 +1,81 @@
+#!/bin/bash
+# Builds every kernel in bench/runtime with skc at -O0 to -O3 and its C twin with the system C
+# compiler, checks that all builds exit with the same code and prints the best run time of each
+# with its ratio to C.
+#
+# USAGE: bench/runtime.sh [build-dir] [kernel...]
+#   CC       C compiler, default cc
+#   CFLAGS   flags for the C twins, default -O2
+#   REPEAT   runs per binary, the fastest counts, default 5
+set -euo pipefail
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+BUILD_DIR=${1:-build}
+shift || true
+SKC="$BUILD_DIR/src/skc"
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-O2"}
+REPEAT=${REPEAT:-5}
+OPT_LEVELS="0 1 2 3"
+
+if [ ! -x "$SKC" ]; then
+    echo "$SKC not found, build skc first" >&2
+    exit 1
+fi
+
+KERNELS=("$@")
+if [ ${#KERNELS[@]} -eq 0 ]; then
+    for source in "$BENCH_DIR"/runtime/*.sk; do
+        KERNELS+=("$(basename "$source" .sk)")
+    done
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# Prints the exit code and the fastest of REPEAT runs in milliseconds
+timeRun()
+{
+    local best="" code=0
+    for _ in $(seq "$REPEAT"); do
+        local start end
+        start=$(date +%s%N)
+        "$1" && code=0 || code=$?
+        end=$(date +%s%N)
+        local ms=$(((end - start) / 1000000))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$code $best"
+}
+
+printf "%-10s %10s" kernel "C ms"
+for level in $OPT_LEVELS; do
+    printf " %16s" "skc -O$level ms"
+done
+printf "\n"
+
+status=0
+for kernel in "${KERNELS[@]}"; do
+    # Skiff i32 arithmetic wraps, so the twins are built with wrapping signed overflow too
+    "$CC" $CFLAGS -fwrapv "$BENCH_DIR/runtime/$kernel.c" -o "$WORK_DIR/$kernel.c.out"
+    read -r cCode cMs < <(timeRun "$WORK_DIR/$kernel.c.out")
+    printf "%-10s %10d" "$kernel" "$cMs"
+
+    for level in $OPT_LEVELS; do
+        object="$WORK_DIR/$kernel.O$level.o"
+        "$SKC" -s -O"$level" -o "$object" "$BENCH_DIR/runtime/$kernel.sk" > /dev/null
+        "$CC" "$object" -o "$WORK_DIR/$kernel.O$level.out"
+        read -r code ms < <(timeRun "$WORK_DIR/$kernel.O$level.out")
+        if [ "$code" != "$cCode" ]; then
+            printf " %16s" "exit $code!=$cCode"
+            status=1
+            continue
+        fi
+        # Ratio to C, with C under a millisecond counting as one
+        printf " %8d %6.2fx" "$ms" "$(echo "$ms $cMs" | awk '{ print $1 / ($2 ? $2 : 1) }')"
+    done
+    printf "\n"
+done
+exit $status
@@ -0,0 +1,23 @@
+int steps(int n)
+{
+    int s = 0;
+    while (n != 1)
+    {
+        n = n % 2 ? 3 * n + 1 : n / 2;
+        ++s;
+    }
+    return s;
+}
+
+int main()
+{
+    int acc = 0;
+    for (int r = 10; r > 0; --r)
+    {
+        for (int n = 99999 - r; n > 0; --n)
+        {
+            acc += steps(n);
+        }
+    }
+    return acc;
+}
@@ -0,0 +1,20 @@
+int gcd(int a, int b)
+{
+    while (b)
+    {
+        int r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+int main()
+{
+    int acc = 0;
+    for (int i = 2500000; i > 0; --i)
+    {
+        acc += gcd(i * 7 + 13, i + 104729);
+    }
+    return acc;
+}
@@ -0,0 +1,9 @@
+int main()
+{
+    int h = 1;
+    for (int n = 300000000; n > 0; --n)
+    {
+        h = h * 31 + n / 7 - h / 65536;
+    }
+    return h;
+}
@@ -0,0 +1,73 @@
+#!/bin/bash
+# Compiles generated programs of growing size with skc and prints time and memory per size.
+# The cost per line should stay flat, a column that grows with the size is a super-linear
+# phase.
+#
+# The phase columns come from --time-report, which makes skc compile sources of 256 KiB and more
+# sequentially instead of pipelining parsing with code generation. The plain column is the wall
+# time of a separate run without the report, on the path skc normally takes.
+#
+# USAGE: bench/scaling.sh [build-dir] [skc arguments...]
+#   SIZES    line counts to generate, default "1000 10000 100000 1000000"
+#   TIMEOUT  seconds before a compile is abandoned, default 1800
+#   GEN_ARGS extra skiff_gen arguments, e.g. "--depth=4 --fan-out=8"
+set -euo pipefail
+
+BUILD_DIR=${1:-build}
+shift || true
+SKC="$BUILD_DIR/src/skc"
+GEN="$BUILD_DIR/bench/skiff_gen"
+SIZES=${SIZES:-"1000 10000 100000 1000000"}
+TIMEOUT=${TIMEOUT:-1800}
+
+for tool in "$SKC" "$GEN"; do
+    if [ ! -x "$tool" ]; then
+        echo "$tool not found, build skc and skiff_gen first" >&2
+        exit 1
+    fi
+done
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+printf "%10s %12s %10s %10s %10s %10s %10s %10s %12s %10s\n" lines bytes lex parse codegen \
+    optimize emit total "us/line" plain
+for lines in $SIZES; do
+    source="$WORK_DIR/gen$lines.sk"
+    # shellcheck disable=SC2086
+    "$GEN" --lines="$lines" ${GEN_ARGS:-} -o "$source"
+    bytes=$(wc -c < "$source")
+
+    report=$(timeout "$TIMEOUT" "$SKC" --time-report=json "$@" "$source" | grep '^{"file"' ||
+        true)
+    if [ -z "$report" ]; then
+        printf "%10s %12s  failed or timed out after %ss\n" "$lines" "$bytes" "$TIMEOUT"
+        continue
+    fi
+
+    start=$(date +%s.%N)
+    if timeout "$TIMEOUT" "$SKC" "$@" "$source" > /dev/null; then
+        plain=$(awk -v start="$start" -v end="$(date +%s.%N)" \
+            'BEGIN { printf "%.3f", end - start }')
+    else
+        plain=failed
+    fi
+
+    # One object per phase in the report, pull out the seconds of each and the last peak RSS
+    echo "$report" | sed 's/},{/}\n{/g' | awk -v lines="$lines" -v bytes="$bytes" \
+        -v plain="$plain" '
+        match($0, /"name":"[a-z]+"/) {
+            name = substr($0, RSTART + 8, RLENGTH - 9)
+            match($0, /"seconds":[0-9.e+-]+/)
+            seconds[name] = substr($0, RSTART + 10, RLENGTH - 10) + 0
+            total += seconds[name]
+            match($0, /"peakRssKiB":[0-9]+/)
+            peak = substr($0, RSTART + 13, RLENGTH - 13)
+        }
+        END {
+            printf "%10d %12d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %12.2f %10s  peak %d MiB\n",
+                lines, bytes, seconds["lex"], seconds["parse"], seconds["codegen"],
+                seconds["optimize"], seconds["emit"], total, total * 1e6 / lines, plain,
+                peak / 1024
+        }'
+done
@@ -0,0 +1,312 @@
+/**
+ * Front-end benchmarks
+ *
+ * Times reading, lexing, parsing, printing and code generation on examples/longFile.sk, on
+ * synthetic sources of a few sizes and on any files given on the command line. Prints one JSON
+ * object per benchmark and input, so runs of two versions can be diffed or loaded into a script.
+ */
+#include "ast.hpp"
+#include "ast_printer.hpp"
+#include "code_gen.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "util/json.hpp"
+#include "util/logger.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::SourceBuffer;
+using sk::Token;
+using sk::TokenKind;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace
+{
+const size_t syntheticSizes[] = {4 * 1024, 64 * 1024, 1024 * 1024};
+
+struct Input
+{
+    string name;
+    string path;
+    // Only synthetic inputs are written to a temporary file that has to be removed
+    bool temporary;
+};
+
+struct Options
+{
+    double minSeconds = 0.5;
+    string filter;
+};
+
+/**
+ * Functions calling the previous one, top-level lets and comments, in the proportions of a
+ * hand written file. Every construct the code generator supports shows up
+ */
+string makeSyntheticSource(size_t size)
+{
+    std::ostringstream os;
+    for (auto i = 0; static_cast<size_t>(os.tellp()) < size; ++i)
+    {
+        auto callee = i == 0 ? 0 : i - 1;
+        os << "# f" << i << " counts x down\n"
+           << "fn f" << i << "(x, y) {\n"
+           << "  if x { f" << callee << "(x - 1, y + " << i % 13 << ") } else { y * "
+           << i % 7 + 1 << " }\n"
+           << "}\n";
+        if (i % 4 == 0)
+        {
+            os << "let v" << i << " = f" << i << "(3, " << i % 5 << ") + 2 * 4\n";
+        }
+    }
+    return os.str();
+}
+
+string writeTemporaryFile(const string& contents)
+{
+    char path[] = "/tmp/skiff_bench_XXXXXX";
+    auto fd = mkstemp(path);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not create a temporary input file");
+    }
+    close(fd);
+    std::ofstream out(path);
+    out << contents;
+    if (!out)
+    {
+        throw std::runtime_error("Could not write a temporary input file");
+    }
+    return path;
+}
+
+/**
+ * Replays tokens lexed ahead of time, so the parser is timed on its own
+ */
+class ReplayTokenSource : public sk::TokenSource
+{
+public:
+    ReplayTokenSource(const vector<Token>& tokens) : m_tokens(tokens) {}
+
+    Token take() override
+    {
+        auto& token = m_tokens[m_next];
+        if (m_next + 1 < m_tokens.size())
+        {
+            ++m_next;
+        }
+        return token;
+    }
+
+private:
+    const vector<Token>& m_tokens;
+    size_t m_next = 0;
+};
+
+vector<Token> lexAll(SourceBuffer& source)
+{
+    vector<Token> tokens;
+    Lexer lexer(source);
+    while (true)
+    {
+        auto token = lexer.take();
+        if (token.isSignificant())
+        {
+            tokens.push_back(token);
+        }
+        if (token.getKind() == TokenKind::END_OF_INPUT)
+        {
+            return tokens;
+        }
+    }
+}
+
+/**
+ * Runs body until minSeconds have passed and prints the median time of one run. body returns
+ * the number of items it handled, e.g. tokens or AST nodes
+ */
+void runBenchmark(const Options& options, const char* benchmark, const Input& input,
+                  size_t bytes, const char* itemName, const std::function<size_t()>& body)
+{
+    if (!options.filter.empty() && string(benchmark).find(options.filter) == string::npos)
+    {
+        return;
+    }
+
+    size_t items = 0;
+    try
+    {
+        // Warm up caches and catch inputs the stage can't handle
+        items = body();
+    }
+    catch (const std::exception& e)
+    {
+        cerr << "Skipping " << benchmark << " on " << input.name << ": " << e.what() << endl;
+        return;
+    }
+
+    vector<double> samples;
+    double total = 0;
+    while (total < options.minSeconds || samples.size() < 3)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        samples.push_back(seconds);
+        total += seconds;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto median = samples[samples.size() / 2];
+
+    cout << "{\"benchmark\":";
+    sk::printJsonString(cout, benchmark);
+    cout << ",\"input\":";
+    sk::printJsonString(cout, input.name);
+    cout << ",\"bytes\":" << bytes << ",\"iterations\":" << samples.size()
+         << ",\"median_ns\":" << static_cast<uint64_t>(median * 1e9)
+         << ",\"min_ns\":" << static_cast<uint64_t>(samples.front() * 1e9)
+         << ",\"mb_per_s\":" << bytes / median / 1e6;
+    if (itemName)
+    {
+        cout << ",\"items\":" << items << ",\"item\":\"" << itemName
+             << "\",\"items_per_s\":" << items / median;
+    }
+    cout << "}" << endl;
+}
+
+void runBenchmarks(const Options& options, const Input& input, llvm::LLVMContext& llvmContext)
+{
+    auto source = SourceBuffer::readFile(input.path.c_str());
+    auto bytes = source.size();
+
+    runBenchmark(options, "read", input, bytes, nullptr, [&] {
+        return SourceBuffer::readFile(input.path.c_str()).size();
+    });
+
+    // Short strings at every offset, so a good share of them straddle two blocks
+    runBenchmark(options, "getString", input, bytes, "strings", [&] {
+        size_t count = 0;
+        for (size_t offset = 0; offset + 16 <= bytes; offset += 8, ++count)
+        {
+            if (source.getString(offset, 16).empty())
+            {
+                throw std::runtime_error("Empty string from getString");
+            }
+        }
+        return count;
+    });
+
+    runBenchmark(options, "lex", input, bytes, "tokens", [&] { return lexAll(source).size(); });
+
+    auto tokens = lexAll(source);
+    runBenchmark(options, "parse", input, bytes, "nodes", [&] {
+        Module module(input.name);
+        ReplayTokenSource replay(tokens);
+        Parser parser(module, replay);
+        parser.parse();
+        return sk::countNodes(module.getMainBlock());
+    });
+
+    Module module(input.name);
+    ReplayTokenSource replay(tokens);
+    Parser parser(module, replay);
+    parser.parse();
+    auto numNodes = sk::countNodes(module.getMainBlock());
+
+    runBenchmark(options, "printAst", input, bytes, "nodes", [&] {
+        std::ostringstream os;
+        sk::AstPrinter printer(os);
+        printer.dispatch(module);
+        return numNodes;
+    });
+
+    runBenchmark(options, "codegen", input, bytes, "nodes", [&] {
+        sk::CodeGen codeGen(input.name, llvmContext);
+        codeGen.dispatch(module);
+        return numNodes;
+    });
+}
+
+void printUsage()
+{
+    cerr << "USAGE: skiff_bench [--min-time=seconds] [--filter=benchmark] [file.sk...]" << endl;
+}
+}
+
+int main(int argc, char** argv)
+{
+    // Logging would dominate the stages that log per function
+    sk::setLogSeverity(sk::LogSeverity::WARN);
+
+    Options options;
+    vector<Input> inputs{{"longFile.sk", SKIFF_EXAMPLES_DIR "/longFile.sk", false}};
+    for (auto i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            inputs.push_back({arg, arg, false});
+        }
+        else if (std::strncmp(arg, "--min-time=", 11) == 0 && std::atof(arg + 11) > 0)
+        {
+            options.minSeconds = std::atof(arg + 11);
+        }
+        else if (std::strncmp(arg, "--filter=", 9) == 0)
+        {
+            options.filter = arg + 9;
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    for (auto size : syntheticSizes)
+    {
+        std::ostringstream name;
+        name << "synthetic-" << size / 1024 << "k";
+        inputs.push_back({name.str(), writeTemporaryFile(makeSyntheticSource(size)), true});
+    }
+
+    llvm::LLVMContext llvmContext;
+    auto status = 0;
+    for (auto& input : inputs)
+    {
+        try
+        {
+            runBenchmarks(options, input, llvmContext);
+        }
+        catch (const std::exception& e)
+        {
+            cerr << input.name << ": error: " << e.what() << endl;
+            status = 1;
+        }
+        if (input.temporary)
+        {
+            std::remove(input.path.c_str());
+        }
+    }
+    return status;
+}
@@ -0,0 +1,267 @@
+/**
+ * Synthetic Skiff corpus generator
+ *
+ * Writes a valid .sk program of roughly the requested number of lines or functions. Every
+ * function takes two arguments, binds a few lets and ends in an if. Calls only go to functions
+ * defined earlier, so the call graph is acyclic and every program compiles. Every eighth function
+ * is exported so the optimizer can't drop most of the program. The same seed always gives the
+ * same program, whichever standard library it is built with.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+using std::ostream;
+using std::string;
+using std::vector;
+
+namespace
+{
+struct GeneratorOptions
+{
+    // Stop after this many lines, unless numFunctions is set
+    size_t numLines = 1000;
+    size_t numFunctions = 0;
+    // Depth of the expression tree bound by every let
+    int depth = 3;
+    size_t minIdLength = 2;
+    size_t maxIdLength = 12;
+    // Chance of a comment line before any line of a function
+    double commentDensity = 0.1;
+    // Earlier functions that the calls of a function pick from
+    size_t fanOut = 2;
+    unsigned seed = 1;
+    string outputPath;
+};
+
+class Generator
+{
+public:
+    Generator(const GeneratorOptions& options, ostream& out)
+        : m_options(options), m_out(out), m_random(options.seed)
+    {
+    }
+
+    void run()
+    {
+        for (size_t i = 0; !isDone(); ++i)
+        {
+            writeFunction(i);
+        }
+        // main returns the last expression
+        if (!m_functions.empty())
+        {
+            m_out << m_functions.back() << "(1, 2)\n";
+        }
+    }
+
+private:
+    bool isDone() const
+    {
+        return m_options.numFunctions ? m_functions.size() >= m_options.numFunctions
+                                      : m_numLines >= m_options.numLines;
+    }
+
+    void writeLine(const string& line)
+    {
+        if (chance(m_options.commentDensity))
+        {
+            m_out << "# note " << makeIdentifier('c', m_numLines) << "\n";
+            ++m_numLines;
+        }
+        m_out << line << '\n';
+        ++m_numLines;
+    }
+
+    void writeFunction(size_t index)
+    {
+        auto name = makeIdentifier('f', index);
+        m_params = {makeIdentifier('a', 2 * index), makeIdentifier('a', 2 * index + 1)};
+        m_locals.clear();
+        m_callees.clear();
+        for (size_t i = 0; i < m_options.fanOut && !m_functions.empty(); ++i)
+        {
+            m_callees.push_back(m_functions[pick(m_functions.size())]);
+        }
+
+        auto exported = index % 8 == 0 ? "*" : "";
+        writeLine("fn " + name + exported + "(" + m_params[0] + ", " + m_params[1] + ") {");
+        auto numLets = 1 + pick(4);
+        for (size_t i = 0; i < numLets; ++i)
+        {
+            auto local = makeIdentifier('v', i);
+            writeLine("  let " + local + " = " + makeExpr(m_options.depth));
+            m_locals.push_back(local);
+        }
+        writeLine("  if " + makeLeaf() + " { " + makeExpr(1) + " } else { " + makeExpr(1) + " }");
+        writeLine("}");
+        m_functions.push_back(name);
+    }
+
+    string makeExpr(int depth)
+    {
+        if (depth <= 0)
+        {
+            return makeLeaf();
+        }
+        static const char* const operators[] = {" + ", " - ", " * "};
+        auto kind = pick(4);
+        if (kind == 0)
+        {
+            return "(" + makeExpr(depth - 1) + ")";
+        }
+        // The first function has nothing to call
+        if (kind == 1 && !m_callees.empty())
+        {
+            return m_callees[pick(m_callees.size())] + "(" + makeExpr(depth - 1) + ", " +
+                   makeExpr(depth - 1) + ")";
+        }
+        return makeExpr(depth - 1) + operators[pick(3)] + makeExpr(depth - 1);
+    }
+
+    string makeLeaf()
+    {
+        auto numNames = m_params.size() + m_locals.size();
+        auto choice = pick(numNames + 1);
+        if (choice == numNames)
+        {
+            return std::to_string(pick(100));
+        }
+        return choice < m_params.size() ? m_params[choice] : m_locals[choice - m_params.size()];
+    }
+
+    /**
+     * prefix and index keep names unique and clear of keywords, random letters pad the name to
+     * a length drawn from the configured range
+     */
+    string makeIdentifier(char prefix, size_t index)
+    {
+        auto id = prefix + std::to_string(index);
+        auto length = m_options.minIdLength +
+                      pick(m_options.maxIdLength - m_options.minIdLength + 1);
+        while (id.size() < length)
+        {
+            id += static_cast<char>('a' + pick(26));
+        }
+        return id;
+    }
+
+    // The standard distributions differ between standard libraries and mt19937 doesn't, so the
+    // mapping to a range is done here to keep the programs the same everywhere
+    size_t pick(size_t n)
+    {
+        // Rejects the values above the last whole multiple of n, which would favor small results
+        const uint64_t range = uint64_t(std::mt19937::max()) + 1;
+        const auto limit = range - range % n;
+        uint64_t value;
+        do
+        {
+            value = m_random();
+        } while (value >= limit);
+        return value % n;
+    }
+
+    bool chance(double p) { return m_random() < p * (uint64_t(std::mt19937::max()) + 1); }
+
+    const GeneratorOptions& m_options;
+    ostream& m_out;
+    std::mt19937 m_random;
+    size_t m_numLines = 0;
+    vector<string> m_functions;
+    vector<string> m_params;
+    vector<string> m_locals;
+    vector<string> m_callees;
+};
+
+void printUsage()
+{
+    cerr << "USAGE: skiff_gen [--lines=N | --functions=N] [--depth=N] [--id-length=MIN-MAX] "
+            "[--comments=0-1] [--fan-out=N] [--seed=N] [-o output.sk]"
+         << endl;
+}
+
+bool parseIdLength(const char* arg, GeneratorOptions& options)
+{
+    char* end = nullptr;
+    auto min = std::strtoul(arg, &end, 10);
+    auto max = *end == '-' ? std::strtoul(end + 1, &end, 10) : min;
+    if (*end || min < 2 || max < min)
+    {
+        return false;
+    }
+    options.minIdLength = min;
+    options.maxIdLength = max;
+    return true;
+}
+}
+
+int main(int argc, char** argv)
+{
+    GeneratorOptions options;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (std::strncmp(arg, "--lines=", 8) == 0 && std::atol(arg + 8) > 0)
+        {
+            options.numLines = std::atol(arg + 8);
+        }
+        else if (std::strncmp(arg, "--functions=", 12) == 0 && std::atol(arg + 12) > 0)
+        {
+            options.numFunctions = std::atol(arg + 12);
+        }
+        else if (std::strncmp(arg, "--depth=", 8) == 0 && std::atoi(arg + 8) >= 0)
+        {
+            options.depth = std::atoi(arg + 8);
+        }
+        else if (std::strncmp(arg, "--id-length=", 12) == 0)
+        {
+            if (!parseIdLength(arg + 12, options))
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (std::strncmp(arg, "--comments=", 11) == 0 && std::atof(arg + 11) >= 0 &&
+                 std::atof(arg + 11) < 1)
+        {
+            options.commentDensity = std::atof(arg + 11);
+        }
+        else if (std::strncmp(arg, "--fan-out=", 10) == 0)
+        {
+            options.fanOut = std::atol(arg + 10);
+        }
+        else if (std::strncmp(arg, "--seed=", 7) == 0)
+        {
+            options.seed = std::atol(arg + 7);
+        }
+        else if (std::strcmp(arg, "-o") == 0 && i + 1 < argc)
+        {
+            options.outputPath = argv[++i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (options.outputPath.empty())
+    {
+        Generator(options, std::cout).run();
+        return 0;
+    }
+    std::ofstream out(options.outputPath);
+    Generator(options, out).run();
+    if (!out)
+    {
+        cerr << "Could not write " << options.outputPath << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * Wasm allocator benchmark
+ *
+ * Runs the same allocation pattern in the Binaryen interpreter with the size class allocator
+ * runtime and with a baseline that grows memory for every allocation.
+ */
+#include "wasm_runner.hpp"
+#include "wasm_runtime.hpp"
+#include <binaryen-c.h>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+using sk::WasmRunner;
+using std::cout;
+using std::endl;
+
+namespace
+{
+const BinaryenIndex heapBase = 16;
+const BinaryenIndex maxMemoryPages = 65536;
+
+BinaryenExpressionRef i32(BinaryenModuleRef module, int32_t value)
+{
+    return BinaryenConst(module, BinaryenLiteralInt32(value));
+}
+
+/**
+ * sk_alloc grows memory by enough pages for the allocation and returns the old end, sk_free
+ * does nothing
+ */
+void addBaselineAllocator(BinaryenModuleRef module)
+{
+    BinaryenType params[] = {BinaryenTypeInt32()};
+    auto type = BinaryenAddFunctionType(module, "baseline_type", BinaryenTypeInt32(), params, 1);
+    BinaryenExpressionRef pages[] = {BinaryenBinary(
+        module, BinaryenShrUInt32(),
+        BinaryenBinary(module, BinaryenAddInt32(),
+                       BinaryenLocalGet(module, 0, BinaryenTypeInt32()), i32(module, 65535)),
+        i32(module, 16))};
+    auto alloc = BinaryenBinary(module, BinaryenShlInt32(),
+                                BinaryenHost(module, BinaryenMemoryGrow(), nullptr, pages, 1),
+                                i32(module, 16));
+    BinaryenAddFunction(module, sk::wasmAllocFunction, type, nullptr, 0, alloc);
+    BinaryenAddFunction(module, sk::wasmFreeFunction, type, nullptr, 0, i32(module, 0));
+}
+
+/**
+ * main allocates count blocks of 16 to 271 bytes and frees every other one right away
+ */
+void addMain(BinaryenModuleRef module, int32_t count)
+{
+    enum { I, PTR };
+    auto get = [&](BinaryenIndex local) {
+        return BinaryenLocalGet(module, local, BinaryenTypeInt32());
+    };
+    BinaryenExpressionRef allocArgs[] = {BinaryenBinary(
+        module, BinaryenAddInt32(), i32(module, 16),
+        BinaryenBinary(module, BinaryenAndInt32(), get(I), i32(module, 255)))};
+    BinaryenExpressionRef freeArgs[] = {get(PTR)};
+    BinaryenExpressionRef loopBody[] = {
+        BinaryenLocalSet(module, PTR,
+                         BinaryenCall(module, sk::wasmAllocFunction, allocArgs, 1,
+                                      BinaryenTypeInt32())),
+        BinaryenIf(module, BinaryenBinary(module, BinaryenAndInt32(), get(I), i32(module, 1)),
+                   BinaryenDrop(module, BinaryenCall(module, sk::wasmFreeFunction, freeArgs, 1,
+                                                     BinaryenTypeInt32())),
+                   nullptr),
+        BinaryenLocalSet(module, I, BinaryenBinary(module, BinaryenSubInt32(), get(I),
+                                                   i32(module, 1))),
+        BinaryenBreak(module, "next", get(I), nullptr),
+    };
+    BinaryenExpressionRef body[] = {
+        BinaryenLocalSet(module, I, i32(module, count)),
+        BinaryenLoop(module, "next",
+                     BinaryenBlock(module, nullptr, loopBody, 4, BinaryenTypeNone())),
+        get(PTR),
+    };
+
+    auto type = BinaryenAddFunctionType(module, "main_type", BinaryenTypeInt32(), nullptr, 0);
+    BinaryenType locals[] = {BinaryenTypeInt32(), BinaryenTypeInt32()};
+    BinaryenAddFunction(module, "main", type, locals, 2,
+                        BinaryenBlock(module, nullptr, body, 3, BinaryenTypeInt32()));
+    BinaryenAddFunctionExport(module, "main", "main");
+}
+
+void runBenchmark(const char* name, bool baseline, int32_t count)
+{
+    auto module = BinaryenModuleCreate();
+    BinaryenSetMemory(module, 1, maxMemoryPages, "memory", nullptr, nullptr, nullptr, nullptr, 0,
+                      0);
+    if (baseline)
+    {
+        addBaselineAllocator(module);
+    }
+    else
+    {
+        sk::addWasmAllocator(module, heapBase);
+    }
+    addMain(module, count);
+    if (!BinaryenModuleValidate(module))
+    {
+        BinaryenModuleDispose(module);
+        throw std::runtime_error("Benchmark module failed validation");
+    }
+
+    cout << "**** " << name << " ****" << endl;
+    WasmRunner runner(module);
+    cout << runner.run() << endl;
+    BinaryenModuleDispose(module);
+}
+}
+
+int main(int argc, char** argv)
+{
+    // Every baseline allocation takes a whole 64KiB page, keep the default count modest
+    auto count = argc > 1 ? std::atoi(argv[1]) : 1000;
+    runBenchmark("size class allocator", false, count);
+    runBenchmark("memory.grow per allocation", true, count);
+}
@@ -0,0 +1,312 @@
+/**
+ * skprof, the runtime of skc --instrument
+ *
+ * Instrumented functions call __sk_prof_enter and __sk_prof_exit with a site that names them.
+ * Calls, self time and total time are kept per function and per caller and callee pair, and a
+ * flat and a call graph profile are printed when the program exits, to stderr or to the file
+ * named by SK_PROF_OUTPUT. Time is counted in timestamp counter cycles where the CPU has one and
+ * converted to milliseconds with the rate measured over the run. Skiff programs are single
+ * threaded, so none of this is thread safe.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Layout shared with CodeGen::instrumentFunction, one per instrumented function
+ */
+struct sk_prof_site
+{
+    const char* name;
+    // 0 until the first entry, then the index into functions plus one
+    uint32_t id;
+};
+
+#define NO_EDGE UINT32_MAX
+
+struct FunctionStats
+{
+    const char* name;
+    uint64_t calls;
+    uint64_t selfCycles;
+    uint64_t totalCycles;
+    // Activations on the stack. Only the outermost of a recursion adds to totalCycles, so time
+    // isn't counted twice
+    uint32_t active;
+};
+
+struct EdgeStats
+{
+    uint32_t caller;
+    uint32_t callee;
+    uint64_t calls;
+    uint64_t totalCycles;
+    uint32_t active;
+};
+
+struct Frame
+{
+    uint32_t function;
+    uint32_t edge;
+    uint64_t start;
+    uint64_t childCycles;
+};
+
+static struct FunctionStats* functions;
+static uint32_t numFunctions;
+static uint32_t functionCapacity;
+
+static struct EdgeStats* edges;
+static uint32_t numEdges;
+static uint32_t edgeCapacity;
+// Open addressing from caller and callee to the index into edges plus one
+static uint32_t* edgeTable;
+static uint32_t edgeTableSize;
+
+static struct Frame* stack;
+static uint32_t depth;
+static uint32_t stackCapacity;
+
+static uint64_t startCycles;
+static uint64_t startNanoseconds;
+
+static uint64_t readNanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t readCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return readNanoseconds();
+#endif
+}
+
+static void* grow(void* array, uint32_t* capacity, size_t elementSize)
+{
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * elementSize);
+    if (!array)
+    {
+        fputs("skprof: out of memory\n", stderr);
+        abort();
+    }
+    return array;
+}
+
+static uint32_t hashEdge(uint32_t caller, uint32_t callee)
+{
+    return (caller * 2654435761u) ^ (callee * 40503u);
+}
+
+static void rehashEdges(void)
+{
+    free(edgeTable);
+    edgeTableSize = edgeTableSize ? edgeTableSize * 2 : 256;
+    edgeTable = calloc(edgeTableSize, sizeof(uint32_t));
+    if (!edgeTable)
+    {
+        fputs("skprof: out of memory\n", stderr);
+        abort();
+    }
+    for (uint32_t i = 0; i < numEdges; ++i)
+    {
+        uint32_t slot = hashEdge(edges[i].caller, edges[i].callee) & (edgeTableSize - 1);
+        while (edgeTable[slot])
+        {
+            slot = (slot + 1) & (edgeTableSize - 1);
+        }
+        edgeTable[slot] = i + 1;
+    }
+}
+
+static uint32_t findEdge(uint32_t caller, uint32_t callee)
+{
+    // Kept at most half full
+    if (2 * (numEdges + 1) > edgeTableSize)
+    {
+        rehashEdges();
+    }
+    uint32_t slot = hashEdge(caller, callee) & (edgeTableSize - 1);
+    for (; edgeTable[slot]; slot = (slot + 1) & (edgeTableSize - 1))
+    {
+        struct EdgeStats* edge = &edges[edgeTable[slot] - 1];
+        if (edge->caller == caller && edge->callee == callee)
+        {
+            return edgeTable[slot] - 1;
+        }
+    }
+    if (numEdges == edgeCapacity)
+    {
+        edges = grow(edges, &edgeCapacity, sizeof(*edges));
+    }
+    struct EdgeStats edge = {caller, callee, 0, 0, 0};
+    edges[numEdges] = edge;
+    edgeTable[slot] = ++numEdges;
+    return numEdges - 1;
+}
+
+static double toMilliseconds(uint64_t cycles, double cyclesPerMillisecond)
+{
+    return cyclesPerMillisecond > 0 ? cycles / cyclesPerMillisecond : 0;
+}
+
+static int compareSelfCycles(const void* a, const void* b)
+{
+    const struct FunctionStats* left = *(const struct FunctionStats* const*)a;
+    const struct FunctionStats* right = *(const struct FunctionStats* const*)b;
+    return left->selfCycles < right->selfCycles ? 1 : left->selfCycles > right->selfCycles ? -1 : 0;
+}
+
+static void printProfile(FILE* out)
+{
+    uint64_t elapsedNanoseconds = readNanoseconds() - startNanoseconds;
+    double cyclesPerMillisecond =
+        elapsedNanoseconds ? (readCycles() - startCycles) * 1e6 / elapsedNanoseconds : 0;
+
+    struct FunctionStats** sorted = malloc(numFunctions * sizeof(*sorted));
+    uint64_t totalSelfCycles = 0;
+    for (uint32_t i = 0; i < numFunctions; ++i)
+    {
+        sorted[i] = &functions[i];
+        totalSelfCycles += functions[i].selfCycles;
+    }
+    qsort(sorted, numFunctions, sizeof(*sorted), compareSelfCycles);
+
+    fprintf(out, "Flat profile, %.3f ms in %u functions\n",
+            toMilliseconds(totalSelfCycles, cyclesPerMillisecond), numFunctions);
+    fprintf(out, "%8s %12s %12s %12s  %s\n", "self %", "self ms", "total ms", "calls", "function");
+    for (uint32_t i = 0; i < numFunctions; ++i)
+    {
+        struct FunctionStats* f = sorted[i];
+        fprintf(out, "%8.2f %12.3f %12.3f %12llu  %s\n",
+                totalSelfCycles ? 100.0 * f->selfCycles / totalSelfCycles : 0,
+                toMilliseconds(f->selfCycles, cyclesPerMillisecond),
+                toMilliseconds(f->totalCycles, cyclesPerMillisecond),
+                (unsigned long long)f->calls, f->name);
+    }
+
+    fprintf(out, "\nCall graph, total ms of a caller and callee pair is the time spent in the "
+                 "callee when called from the caller\n");
+    for (uint32_t i = 0; i < numFunctions; ++i)
+    {
+        struct FunctionStats* f = sorted[i];
+        uint32_t id = (uint32_t)(f - functions);
+        fprintf(out, "%s  %llu calls  %.3f ms total\n", f->name, (unsigned long long)f->calls,
+                toMilliseconds(f->totalCycles, cyclesPerMillisecond));
+        for (uint32_t e = 0; e < numEdges; ++e)
+        {
+            if (edges[e].callee == id)
+            {
+                fprintf(out, "    called by %-24s %12llu calls %12.3f ms\n",
+                        functions[edges[e].caller].name, (unsigned long long)edges[e].calls,
+                        toMilliseconds(edges[e].totalCycles, cyclesPerMillisecond));
+            }
+        }
+        for (uint32_t e = 0; e < numEdges; ++e)
+        {
+            if (edges[e].caller == id)
+            {
+                fprintf(out, "    calls     %-24s %12llu calls %12.3f ms\n",
+                        functions[edges[e].callee].name, (unsigned long long)edges[e].calls,
+                        toMilliseconds(edges[e].totalCycles, cyclesPerMillisecond));
+            }
+        }
+    }
+    free(sorted);
+}
+
+static void writeProfile(void)
+{
+    const char* path = getenv("SK_PROF_OUTPUT");
+    FILE* out = path ? fopen(path, "w") : NULL;
+    if (path && !out)
+    {
+        fprintf(stderr, "skprof: cannot write %s, printing the profile here\n", path);
+    }
+    printProfile(out ? out : stderr);
+    if (out)
+    {
+        fclose(out);
+    }
+}
+
+static void registerSite(struct sk_prof_site* site)
+{
+    if (numFunctions == 0)
+    {
+        startNanoseconds = readNanoseconds();
+        startCycles = readCycles();
+        atexit(writeProfile);
+    }
+    if (numFunctions == functionCapacity)
+    {
+        functions = grow(functions, &functionCapacity, sizeof(*functions));
+    }
+    struct FunctionStats stats = {site->name, 0, 0, 0, 0};
+    functions[numFunctions] = stats;
+    site->id = ++numFunctions;
+}
+
+void __sk_prof_enter(struct sk_prof_site* site)
+{
+    if (!site->id)
+    {
+        registerSite(site);
+    }
+    uint32_t function = site->id - 1;
+    uint32_t edge = depth ? findEdge(stack[depth - 1].function, function) : NO_EDGE;
+    if (depth == stackCapacity)
+    {
+        stack = grow(stack, &stackCapacity, sizeof(*stack));
+    }
+
+    ++functions[function].calls;
+    ++functions[function].active;
+    if (edge != NO_EDGE)
+    {
+        ++edges[edge].calls;
+        ++edges[edge].active;
+    }
+    struct Frame* frame = &stack[depth++];
+    frame->function = function;
+    frame->edge = edge;
+    frame->childCycles = 0;
+    // Last, so the bookkeeping above counts toward the caller
+    frame->start = readCycles();
+}
+
+void __sk_prof_exit(struct sk_prof_site* site)
+{
+    uint64_t now = readCycles();
+    if (depth == 0 || stack[depth - 1].function != site->id - 1)
+    {
+        return;
+    }
+    struct Frame* frame = &stack[--depth];
+    uint64_t elapsed = now - frame->start;
+
+    struct FunctionStats* stats = &functions[frame->function];
+    stats->selfCycles += elapsed - frame->childCycles;
+    if (--stats->active == 0)
+    {
+        stats->totalCycles += elapsed;
+    }
+    if (frame->edge != NO_EDGE && --edges[frame->edge].active == 0)
+    {
+        edges[frame->edge].totalCycles += elapsed;
+    }
+    if (depth)
+    {
+        stack[depth - 1].childCycles += elapsed;
+    }
+}
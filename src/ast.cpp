@@ -52,8 +52,8 @@ UnaryOp::UnaryOp(Token token, std::unique_ptr<Expr>&& arg) : m_token(token), m_a
     addChild(move(arg));
 };
 
-Function::Function(unique_ptr<Identifier>&& id, unique_ptr<TupleMatch>&& args)
-    : m_id(id.get()), m_argMatch(args.get())
+Function::Function(unique_ptr<Identifier>&& id, unique_ptr<TupleMatch>&& args, bool isExported)
+    : m_id(id.get()), m_argMatch(args.get()), m_isExported(isExported)
 {
     assert(m_id);
     assert(m_argMatch);
@@ -93,4 +93,17 @@ IfExpr::IfExpr(std::unique_ptr<Expr>&& condition, std::unique_ptr<Block>&& thenB
     addChild(move(thenBlock));
     addChild(move(elseBlock));
 }
+
+size_t countNodes(const AstNode& node)
+{
+    size_t count = 1;
+    for (auto& child : node.children())
+    {
+        if (child)
+        {
+            count += countNodes(*child);
+        }
+    }
+    return count;
+}
 }
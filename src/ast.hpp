@@ -185,17 +185,22 @@ private:
 class Function : public Expr
 {
 public:
-    Function(std::unique_ptr<Identifier>&& id, std::unique_ptr<TupleMatch>&& args);
+    Function(std::unique_ptr<Identifier>&& id, std::unique_ptr<TupleMatch>&& args,
+             bool isExported = false);
     void accept(AstVisitor& visitor) override { visitor.visit(*this); }
 
     string_view getName() const { return m_id->getName(); }
     TupleMatch& getArgumentMatch() const { return *m_argMatch; }
     Block& getBlock() { return *m_block; }
 
+    // Exported functions are marked with a trailing '*', e.g. fn drop*()
+    bool isExported() const { return m_isExported; }
+
 private:
     Identifier* m_id;
     TupleMatch* m_argMatch;
     Block* m_block;
+    const bool m_isExported;
 };
 
 class FunctionCall : public Expr
@@ -253,4 +258,9 @@ public:
 private:
     const string_view m_str;
 };
+
+/**
+ * Number of nodes in the tree rooted at node, including node
+ */
+size_t countNodes(const AstNode& node);
 }
@@ -51,7 +51,7 @@ void AstPrinter::visit(Function& func)
 {
     indent();
     ++m_depth;
-    m_out << "Function " << func.getName();
+    m_out << "Function " << func.getName() << (func.isExported() ? "*" : "");
     auto first = true;
     dispatch(func.getArgumentMatch());
     dispatch(func.getBlock());
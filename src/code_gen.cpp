@@ -1,17 +1,22 @@
 #include "code_gen.hpp"
 #include "util/logger.hpp"
+#include "util/trace.hpp"
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
@@ -30,8 +35,10 @@ using std::vector;
 
 namespace sk
 {
-CodeGen::CodeGen(string_view sourceFile)
-    : m_irBuilder(m_llvmContext),
+CodeGen::CodeGen(string_view sourceFile, llvm::LLVMContext& llvmContext, bool instrument)
+    : m_instrument(instrument),
+      m_llvmContext(llvmContext),
+      m_irBuilder(m_llvmContext),
       m_module(new llvm::Module(llvm::StringRef(sourceFile.data(), sourceFile.size()),
                                 m_llvmContext))
 {
@@ -40,48 +47,120 @@ CodeGen::CodeGen(string_view sourceFile)
 void CodeGen::visit(Module& module)
 {
     logi << "Codegen::visit module";
+    beginModule();
+    for (auto& expr : module.getMainBlock().getExpressions())
+    {
+        addTopLevelExpr(expr);
+    }
+    finishModule(module);
+}
 
+void CodeGen::beginModule()
+{
     // puts function
     vector<llvm::Type*> putsParameters = { llvm::Type::getInt8PtrTy(m_llvmContext) };
     auto putsType =
         llvm::FunctionType::get(llvm::Type::getInt32Ty(m_llvmContext), move(putsParameters), false);
     auto putsFunc =
         llvm::Function::Create(putsType, llvm::Function::ExternalLinkage, "puts", m_module.get());
+    m_functions["puts"] = putsFunc;
 
+    if (m_instrument)
+    {
+        // struct sk_prof_site from sklib/skprof.c, the runtime fills in the id on first entry
+        m_profSiteType = llvm::StructType::create(
+            m_llvmContext,
+            {llvm::Type::getInt8PtrTy(m_llvmContext), llvm::Type::getInt32Ty(m_llvmContext)},
+            "sk_prof_site");
+        auto profType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_llvmContext),
+                                                {m_profSiteType->getPointerTo()}, false);
+        m_profEnter = llvm::Function::Create(profType, llvm::Function::ExternalLinkage,
+                                             "__sk_prof_enter", m_module.get());
+        m_profExit = llvm::Function::Create(profType, llvm::Function::ExternalLinkage,
+                                            "__sk_prof_exit", m_module.get());
+    }
 
     vector<llvm::Type*> parameterList = {
         llvm::Type::getInt32Ty(m_llvmContext),
         llvm::PointerType::get(llvm::Type::getInt8PtrTy(m_llvmContext), 0)};
     auto funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_llvmContext),
                                             move(parameterList), false);
-    auto llvmFunc = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "main",
-                                           m_module.get());
-    auto arg = llvmFunc->args().begin();
+    m_main = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "main",
+                                    m_module.get());
+    auto arg = m_main->args().begin();
     arg->setName("argc");
     ++arg;
     arg->setName("argv");
 
-    auto bb = llvm::BasicBlock::Create(m_llvmContext, "", llvmFunc);
+    auto bb = llvm::BasicBlock::Create(m_llvmContext, "", m_main);
     m_irBuilder.SetInsertPoint(bb);
-    dispatch(module.getMainBlock());
+    m_mainHasCode = false;
+}
 
-    //auto returnBlock = llvm::BasicBlock::Create(m_llvmContext, "", llvmFunc);
-    //m_irBuilder.SetInsertPoint(returnBlock);
-    m_irBuilder.CreateRet(m_value);
+void CodeGen::addTopLevelExpr(Expr& expr)
+{
+    if (!dynamic_cast<Function*>(&expr))
+    {
+        m_mainHasCode = true;
+    }
+    m_isTailPosition = false;
+    dispatch(expr);
+}
+
+void CodeGen::finishModule(Module& module)
+{
+    m_effectAnalysis.dispatch(module);
+    // Calls into the profiling runtime are effects the analysis doesn't see
+    if (!m_instrument)
+    {
+        for (auto& defined : m_definedFunctions)
+        {
+            addEffectAttributes(*defined.first, *defined.second);
+        }
+    }
+
+    markMustTailCalls();
+
+    // A module of only function definitions is a library, giving it a main would clash with the
+    // main of whatever program it gets linked into
+    if (m_mainHasCode)
+    {
+        m_irBuilder.CreateRet(m_value);
+        if (m_instrument)
+        {
+            instrumentFunction(*m_main);
+        }
+    }
+    else
+    {
+        m_main->eraseFromParent();
+    }
+    m_main = nullptr;
+}
+
+void CodeGen::defineConstant(string_view name, int32_t value)
+{
+    m_symbols[name] = ConstantInt::getSigned(Type::getInt32Ty(m_llvmContext), value);
 }
 
 void CodeGen::visit(Block& block)
 {
     logi << "Codegen::visit block";
-    for (auto& e : block.getExpressions())
+    // Only the last expression of a block inherits the block's tail position
+    auto isTailPosition = m_isTailPosition;
+    auto& expressions = block.getExpressions();
+    for (auto i = 0u; i < expressions.size(); ++i)
     {
-        dispatch(e);
+        m_isTailPosition = isTailPosition && i + 1 == expressions.size();
+        dispatch(expressions[i]);
     }
+    m_isTailPosition = false;
 }
 
 void CodeGen::visit(LetExpr& letExpr)
 {
     logi << "Codegen::visit let";
+    m_isTailPosition = false;
     dispatch(letExpr.getExpr());
     m_symbols[letExpr.getIdentifier().getName()] = m_value;
 }
@@ -93,6 +172,7 @@ void CodeGen::visit(Expr& expr)
 
 void CodeGen::visit(Function& func)
 {
+    TraceSpan span("codegen function", func.getName());
     logi << "Codegen::visit func";
     vector<llvm::Type*> parameterList;
     for (auto& m : func.getArgumentMatch().matches())
@@ -102,31 +182,108 @@ void CodeGen::visit(Function& func)
     auto funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_llvmContext),
                                             move(parameterList), false);
     auto funcName = func.getName();
-    auto llvmFunc = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                           llvm::StringRef(funcName.data(), funcName.size()),
-                                           m_module.get());
-    auto arg = llvmFunc->args().begin();
-    for (auto& m : func.getArgumentMatch().matches())
+    auto linkage =
+        func.isExported() ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage;
+    auto llvmFunc = m_module->getFunction(llvm::StringRef(funcName.data(), funcName.size()));
+    if (llvmFunc && llvmFunc->isDeclaration())
     {
-        auto& idMatch = dynamic_cast<const IdMatch&>(m.get());
-        auto name = idMatch.getId().getName();
-        arg->setName(llvm::StringRef(name.data(), name.size()));
-        m_symbols[name] = &*arg;
+        // Called before it was defined, complete the declaration
+        if (llvmFunc->getFunctionType() != funcType)
+        {
+            ostringstream ss;
+            ss << "Function " << funcName << " defined with " << funcType->getNumParams()
+               << " parameters, but called with " << llvmFunc->arg_size();
+            throw runtime_error(ss.str());
+        }
+        llvmFunc->setLinkage(linkage);
+    }
+    else
+    {
+        llvmFunc = llvm::Function::Create(funcType, linkage,
+                                          llvm::StringRef(funcName.data(), funcName.size()),
+                                          m_module.get());
+    }
+    if (!func.isExported())
+    {
+        // Only callable from this module, so LLVM is free to change the signature
+        llvmFunc->setCallingConv(llvm::CallingConv::Fast);
+        for (auto user : llvmFunc->users())
+        {
+            if (auto callInst = llvm::dyn_cast<llvm::CallInst>(user))
+            {
+                callInst->setCallingConv(llvm::CallingConv::Fast);
+            }
+        }
     }
-
     m_functions[funcName] = llvmFunc;
+    m_definedFunctions.emplace_back(&func, llvmFunc);
 
     auto oldInsertBlock = m_irBuilder.GetInsertBlock();
     auto oldInsertPoint = m_irBuilder.GetInsertPoint();
+    auto oldFunction = m_function;
+    auto oldTailRecurseBlock = m_tailRecurseBlock;
+    auto oldArgumentPhis = move(m_argumentPhis);
+
+    // Self-recursive tail calls branch back to the tailrecurse block, so arguments flow
+    // through phi nodes rather than being used directly
+    auto entryBlock = llvm::BasicBlock::Create(m_llvmContext, "entry", llvmFunc);
+    auto tailRecurseBlock = llvm::BasicBlock::Create(m_llvmContext, "tailrecurse", llvmFunc);
+    m_irBuilder.SetInsertPoint(entryBlock);
+    m_irBuilder.CreateBr(tailRecurseBlock);
+    m_irBuilder.SetInsertPoint(tailRecurseBlock);
+
+    m_argumentPhis.clear();
+    auto arg = llvmFunc->args().begin();
+    for (auto& m : func.getArgumentMatch().matches())
+    {
+        auto& idMatch = dynamic_cast<const IdMatch&>(m.get());
+        auto name = idMatch.getId().getName();
+        auto llvmName = llvm::StringRef(name.data(), name.size());
+        arg->setName(llvmName);
+        auto phi = m_irBuilder.CreatePHI(Type::getInt32Ty(m_llvmContext), 2, llvmName + ".tr");
+        phi->addIncoming(&*arg, entryBlock);
+        m_argumentPhis.push_back(phi);
+        m_symbols[name] = phi;
+        ++arg;
+    }
 
-    auto bb = llvm::BasicBlock::Create(m_llvmContext, "entry", llvmFunc);
-    m_irBuilder.SetInsertPoint(bb);
-
+    m_function = llvmFunc;
+    m_tailRecurseBlock = tailRecurseBlock;
+    m_isTailPosition = true;
     dispatch(func.getBlock());
+    m_isTailPosition = false;
 
-    m_irBuilder.CreateRet(m_value);
+    if (!m_irBuilder.GetInsertBlock()->getTerminator())
+    {
+        m_irBuilder.CreateRet(m_value);
+    }
+    if (m_instrument)
+    {
+        instrumentFunction(*llvmFunc);
+    }
 
-    m_irBuilder.SetInsertPoint(oldInsertBlock, oldInsertPoint);
+    if (tailRecurseBlock->getSinglePredecessor() == entryBlock)
+    {
+        // No self-recursive tail calls, fold the loop header back into the entry block
+        for (auto phi : m_argumentPhis)
+        {
+            phi->replaceAllUsesWith(phi->getIncomingValue(0));
+            phi->eraseFromParent();
+        }
+        llvm::MergeBlockIntoPredecessor(tailRecurseBlock);
+    }
+
+    m_function = oldFunction;
+    m_tailRecurseBlock = oldTailRecurseBlock;
+    m_argumentPhis = move(oldArgumentPhis);
+    if (oldInsertBlock)
+    {
+        m_irBuilder.SetInsertPoint(oldInsertBlock, oldInsertPoint);
+    }
+    else
+    {
+        m_irBuilder.ClearInsertionPoint();
+    }
 
     m_value = ConstantInt::getSigned(Type::getInt32Ty(m_llvmContext), 0);
 }
@@ -134,23 +291,156 @@ void CodeGen::visit(Function& func)
 void CodeGen::visit(FunctionCall& call)
 {
     logi << "Codegen::visit function call";
+    auto isTailCall = m_isTailPosition;
+    m_isTailPosition = false;
     auto funcName = call.getId().getName();
+    vector<llvm::Value*> llvmArgs;
+    for (auto& arg : call.getArguments())
+    {
+        dispatch(arg);
+        llvmArgs.push_back(m_value);
+    }
+
     auto llvmFunc = m_functions.find(funcName);
-    if (llvmFunc == m_functions.end())
+    auto callee = llvmFunc == m_functions.end() ? declareFunction(funcName, llvmArgs.size())
+                                                : llvmFunc->second;
+    auto paramTypes = callee->getFunctionType()->params();
+    if (paramTypes.size() != llvmArgs.size())
     {
         ostringstream ss;
-        ss << "Could not resolve function: " << funcName;
+        ss << "Wrong number of arguments in call to " << funcName;
         throw runtime_error(ss.str());
     }
+    for (auto i = 0u; i < llvmArgs.size(); ++i)
+    {
+        // String literals are arrays, builtins like puts take a plain i8*
+        if (llvmArgs[i]->getType() != paramTypes[i] && llvmArgs[i]->getType()->isPointerTy() &&
+            paramTypes[i]->isPointerTy())
+        {
+            llvmArgs[i] = m_irBuilder.CreatePointerCast(llvmArgs[i], paramTypes[i]);
+        }
+    }
+    if (isTailCall && callee == m_function)
+    {
+        // Self-recursive tail call, loop back to the top of the function
+        auto currentBlock = m_irBuilder.GetInsertBlock();
+        for (auto i = 0u; i < llvmArgs.size(); ++i)
+        {
+            m_argumentPhis[i]->addIncoming(llvmArgs[i], currentBlock);
+        }
+        m_irBuilder.CreateBr(m_tailRecurseBlock);
+        m_value = llvm::UndefValue::get(Type::getInt32Ty(m_llvmContext));
+        return;
+    }
 
-    vector<llvm::Value*> llvmArgs;
-    for (auto& arg : call.getArguments())
+    auto callInst = m_irBuilder.CreateCall(callee, llvmArgs);
+    callInst->setCallingConv(callee->getCallingConv());
+    m_value = callInst;
+    if (isTailCall && m_function)
     {
-        dispatch(arg);
-        llvmArgs.push_back(m_value);
+        // Return straight from the call so the backend can reuse the caller's frame. Whether
+        // it can be musttail is only known once every calling convention is final, so
+        // finishModule decides. Instrumented functions call the runtime between the call and
+        // the return, so their frames stay
+        if (!m_instrument)
+        {
+            callInst->setTailCallKind(llvm::CallInst::TCK_Tail);
+            m_tailCalls.push_back(callInst);
+        }
+        m_irBuilder.CreateRet(callInst);
+    }
+}
+
+llvm::Function* CodeGen::declareFunction(string_view name, size_t arity)
+{
+    // Unknown functions are assumed to be defined later in the module or in another module
+    // that gets linked in, so unresolved calls surface as linker errors
+    auto llvmName = llvm::StringRef(name.data(), name.size());
+    auto llvmFunc = m_module->getFunction(llvmName);
+    if (!llvmFunc)
+    {
+        vector<llvm::Type*> parameterList(arity, llvm::Type::getInt32Ty(m_llvmContext));
+        auto funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_llvmContext),
+                                                move(parameterList), false);
+        llvmFunc = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, llvmName,
+                                          m_module.get());
+    }
+    m_functions[name] = llvmFunc;
+    return llvmFunc;
+}
+
+void CodeGen::addEffectAttributes(const Function& func, llvm::Function& llvmFunc)
+{
+    switch (m_effectAnalysis.getEffect(func))
+    {
+        case Effect::PURE:
+            llvmFunc.setDoesNotAccessMemory();
+            break;
+        case Effect::READ_ONLY:
+            llvmFunc.setOnlyReadsMemory();
+            break;
+        case Effect::SIDE_EFFECT:
+            break;
+    }
+    if (m_effectAnalysis.isNoUnwind(func))
+    {
+        llvmFunc.setDoesNotThrow();
     }
+#if LLVM_VERSION_MAJOR >= 12
+    // Without willreturn LLVM must keep calls whose results are unused, since they might loop
+    if (m_effectAnalysis.willReturn(func))
+    {
+        llvmFunc.setWillReturn();
+    }
+#endif
+}
 
-    m_value = m_irBuilder.CreateCall(llvmFunc->second, llvmArgs);
+void CodeGen::markMustTailCalls()
+{
+    // musttail needs the caller and callee prototypes and calling conventions to match. Callees
+    // that were declared before their definition only got their calling convention since
+    for (auto callInst : m_tailCalls)
+    {
+        auto caller = callInst->getFunction();
+        auto callee = callInst->getCalledFunction();
+        if (callee && callee->getFunctionType() == caller->getFunctionType() &&
+            callee->getCallingConv() == caller->getCallingConv() &&
+            callInst->getCallingConv() == callee->getCallingConv())
+        {
+            callInst->setTailCallKind(llvm::CallInst::TCK_MustTail);
+        }
+    }
+    m_tailCalls.clear();
+}
+
+void CodeGen::instrumentFunction(llvm::Function& llvmFunc)
+{
+    auto name = llvm::ConstantDataArray::getString(m_llvmContext, llvmFunc.getName());
+    auto nameGlobal = new llvm::GlobalVariable(*m_module, name->getType(), true,
+                                               llvm::GlobalValue::PrivateLinkage, name,
+                                               "__sk_prof_name." + llvmFunc.getName());
+    auto zero = ConstantInt::get(Type::getInt32Ty(m_llvmContext), 0);
+    llvm::Constant* siteFields[] = {
+        llvm::ConstantExpr::getInBoundsGetElementPtr(name->getType(), nameGlobal,
+                                                     llvm::ArrayRef<llvm::Constant*>{zero, zero}),
+        zero};
+    auto site = new llvm::GlobalVariable(*m_module, m_profSiteType, false,
+                                         llvm::GlobalValue::PrivateLinkage,
+                                         llvm::ConstantStruct::get(m_profSiteType, siteFields),
+                                         "__sk_prof_site." + llvmFunc.getName());
+
+    // Entry goes before everything, so self-recursive tail calls that loop back count once
+    auto& entryBlock = llvmFunc.getEntryBlock();
+    llvm::IRBuilder<> builder(&entryBlock, entryBlock.getFirstInsertionPt());
+    builder.CreateCall(m_profEnter, {site});
+    for (auto& block : llvmFunc)
+    {
+        if (auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(block.getTerminator()))
+        {
+            builder.SetInsertPoint(ret);
+            builder.CreateCall(m_profExit, {site});
+        }
+    }
 }
 
 void CodeGen::visit(Identifier& variable)
@@ -181,12 +471,13 @@ void CodeGen::visit(StringLiteral& str)
     auto llvmConst =
         llvm::ConstantDataArray::getString(m_llvmContext, {literal.data(), literal.size()});
     m_value = new llvm::GlobalVariable(*m_module, stringType, true,
-                                       llvm::GlobalValue::CommonLinkage, llvmConst);
+                                       llvm::GlobalValue::PrivateLinkage, llvmConst);
 }
 
 void CodeGen::visit(BinaryOp& binOp)
 {
     logi << "Codegen::visit binary op";
+    m_isTailPosition = false;
     dispatch(binOp.getLhs());
     auto lhs = m_value;
     dispatch(binOp.getRhs());
@@ -215,6 +506,8 @@ void CodeGen::visit(BinaryOp& binOp)
 void CodeGen::visit(IfExpr& expr)
 {
     logi << "Codegen::visit if";
+    auto isTailPosition = m_isTailPosition;
+    m_isTailPosition = false;
     dispatch(*expr.getCondition());
 
     auto* zeroConstant = ConstantInt::getSigned(Type::getInt32Ty(m_llvmContext), 0);
@@ -225,25 +518,50 @@ void CodeGen::visit(IfExpr& expr)
     auto* mergeBlock = llvm::BasicBlock::Create(m_llvmContext, "ifcont");
     m_irBuilder.CreateCondBr(cond, thenBlock, elseBlock);
 
+    // Branches ending in a tail call have already returned or looped and don't reach the merge
     m_irBuilder.SetInsertPoint(thenBlock);
+    m_isTailPosition = isTailPosition;
     dispatch(*expr.getThenBlock());
     auto* thenValue = m_value;
-    m_irBuilder.CreateBr(mergeBlock);
     thenBlock = m_irBuilder.GetInsertBlock();
+    auto thenFallsThrough = !thenBlock->getTerminator();
+    if (thenFallsThrough)
+    {
+        m_irBuilder.CreateBr(mergeBlock);
+    }
 
     llvmFunc->getBasicBlockList().push_back(elseBlock);
     m_irBuilder.SetInsertPoint(elseBlock);
+    m_isTailPosition = isTailPosition;
     dispatch(*expr.getElseBlock());
     auto* elseValue = m_value;
-    m_irBuilder.CreateBr(mergeBlock);
     elseBlock = m_irBuilder.GetInsertBlock();
+    auto elseFallsThrough = !elseBlock->getTerminator();
+    if (elseFallsThrough)
+    {
+        m_irBuilder.CreateBr(mergeBlock);
+    }
+    m_isTailPosition = false;
+
+    if (!thenFallsThrough && !elseFallsThrough)
+    {
+        delete mergeBlock;
+        m_value = llvm::UndefValue::get(Type::getInt32Ty(m_llvmContext));
+        return;
+    }
 
     llvmFunc->getBasicBlockList().push_back(mergeBlock);
     m_irBuilder.SetInsertPoint(mergeBlock);
     auto* phiNode = m_irBuilder.CreatePHI(Type::getInt32Ty(m_llvmContext), 2, "iftmp");
 
-    phiNode->addIncoming(thenValue, thenBlock);
-    phiNode->addIncoming(elseValue, elseBlock);
+    if (thenFallsThrough)
+    {
+        phiNode->addIncoming(thenValue, thenBlock);
+    }
+    if (elseFallsThrough)
+    {
+        phiNode->addIncoming(elseValue, elseBlock);
+    }
 
     m_value = phiNode;
 }
@@ -1,20 +1,43 @@
 #pragma once
 #include "ast.hpp"
+#include "effect_analysis.hpp"
+#include <llvm/IR/Function.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <map>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace sk
 {
 class CodeGen : public AstVisitor
 {
 public:
-    CodeGen(string_view sourceFile);
+    /**
+     * instrument: call the skprof runtime on entry to and exit from every function
+     */
+    CodeGen(string_view sourceFile, llvm::LLVMContext& llvmContext, bool instrument = false);
 
     void visit(Module& module) override;
+
+    /**
+     * Incremental alternative to visiting the Module, for top-level expressions that arrive while
+     * the rest of the file is still being parsed. Effect attributes need the whole module, so
+     * they are added by finishModule()
+     */
+    void beginModule();
+    void addTopLevelExpr(Expr& expr);
+    void finishModule(Module& module);
+
+    /**
+     * Makes name refer to value in the code generated after this, for values computed by code
+     * that already ran, like the top level lets of earlier REPL lines
+     */
+    void defineConstant(string_view name, int32_t value);
+
     void visit(Block& block) override;
     void visit(LetExpr& expr) override;
     void visit(Expr& expr) override;
@@ -31,13 +54,41 @@ public:
     void visit(TypeMatch& match) override;
 
     llvm::Module& getLlvmModule() { return *m_module; }
+    std::unique_ptr<llvm::Module> takeLlvmModule() { return std::move(m_module); }
 
 private:
     std::map<string_view, llvm::Value*> m_symbols;
-    std::map<string_view, llvm::Value*> m_functions;
+    std::map<string_view, llvm::Function*> m_functions;
     Block* m_block = nullptr;
     llvm::Value* m_value = nullptr;
-    llvm::LLVMContext m_llvmContext;
+
+    // Tail call state for the function currently being generated
+    bool m_isTailPosition = false;
+    llvm::Function* m_function = nullptr;
+    llvm::BasicBlock* m_tailRecurseBlock = nullptr;
+    std::vector<llvm::PHINode*> m_argumentPhis;
+    // Calls in tail position, upgraded to musttail by markMustTailCalls where allowed
+    std::vector<llvm::CallInst*> m_tailCalls;
+
+    // main is created before any code is generated and removed again if the module turns out to
+    // be a library
+    llvm::Function* m_main = nullptr;
+    bool m_mainHasCode = false;
+    std::vector<std::pair<const Function*, llvm::Function*>> m_definedFunctions;
+
+    llvm::Function* declareFunction(string_view name, size_t arity);
+    void addEffectAttributes(const Function& func, llvm::Function& llvmFunc);
+    void markMustTailCalls();
+    void instrumentFunction(llvm::Function& llvmFunc);
+
+    const bool m_instrument;
+    llvm::StructType* m_profSiteType = nullptr;
+    llvm::Function* m_profEnter = nullptr;
+    llvm::Function* m_profExit = nullptr;
+
+    EffectAnalysis m_effectAnalysis;
+
+    llvm::LLVMContext& m_llvmContext;
     llvm::IRBuilder<> m_irBuilder;
     std::unique_ptr<llvm::Module> m_module;
 };
@@ -0,0 +1,297 @@
+#include "compile_server.hpp"
+#include "driver.hpp"
+#include "llvm_backend.hpp"
+#include "util/logger.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::istringstream;
+using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::to_string;
+using std::vector;
+
+namespace
+{
+void throwUvError(const char* what, int error)
+{
+    ostringstream ss;
+    ss << what << ": " << uv_strerror(error);
+    throw runtime_error(ss.str());
+}
+
+void allocBuffer(uv_handle_t*, size_t suggestedSize, uv_buf_t* buf)
+{
+    *buf = uv_buf_init(new char[suggestedSize], static_cast<unsigned int>(suggestedSize));
+}
+}
+
+namespace sk
+{
+string getDefaultCompileServerSocket()
+{
+    if (auto runtimeDir = std::getenv("XDG_RUNTIME_DIR"))
+    {
+        return string(runtimeDir) + "/skcd.sock";
+    }
+    return "/tmp/skcd-" + to_string(getuid()) + ".sock";
+}
+
+struct CompileServer::Connection
+{
+    uv_pipe_t pipe;
+    uv_write_t write;
+    CompileServer* server;
+    string request;
+    string response;
+
+    static void close(uv_handle_t* handle)
+    {
+        uv_close(handle, [](uv_handle_t* closed) { delete static_cast<Connection*>(closed->data); });
+    }
+};
+
+CompileServer::CompileServer(const string& socketPath)
+    : m_socketPath(socketPath), m_llvmContext(new llvm::LLVMContext())
+{
+    initLlvmTargets();
+    // A client killed during a long compile makes writing its response raise SIGPIPE, which
+    // would take the server down with it. libuv reports the write as EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
+    uv_loop_init(&m_loop);
+    uv_pipe_init(&m_loop, &m_listener, 0);
+    m_listener.data = this;
+    uv_signal_init(&m_loop, &m_sigint);
+    m_sigint.data = this;
+    uv_signal_init(&m_loop, &m_sigterm);
+    m_sigterm.data = this;
+
+    // A socket left behind by a server that was killed would make bind fail
+    unlink(m_socketPath.c_str());
+    if (auto error = uv_pipe_bind(&m_listener, m_socketPath.c_str()))
+    {
+        throwUvError(m_socketPath.c_str(), error);
+    }
+    if (auto error = uv_listen(reinterpret_cast<uv_stream_t*>(&m_listener), 128, onConnection))
+    {
+        throwUvError(m_socketPath.c_str(), error);
+    }
+    logi << "Listening on " << m_socketPath;
+}
+
+CompileServer::~CompileServer()
+{
+    // Connections are the only handles whose data is not the server
+    uv_walk(&m_loop,
+            [](uv_handle_t* handle, void* server) {
+                if (uv_is_closing(handle))
+                {
+                    return;
+                }
+                if (handle->data == server)
+                {
+                    uv_close(handle, nullptr);
+                }
+                else
+                {
+                    Connection::close(handle);
+                }
+            },
+            this);
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+    uv_loop_close(&m_loop);
+    unlink(m_socketPath.c_str());
+}
+
+void CompileServer::run()
+{
+    uv_signal_start(&m_sigint, onSignal, SIGINT);
+    uv_signal_start(&m_sigterm, onSignal, SIGTERM);
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+    logi << "Served " << m_numRequests << " requests";
+}
+
+void CompileServer::onConnection(uv_stream_t* listener, int status)
+{
+    if (status < 0)
+    {
+        loge << "Connection failed: " << uv_strerror(status);
+        return;
+    }
+
+    auto server = static_cast<CompileServer*>(listener->data);
+    auto connection = new Connection();
+    connection->server = server;
+    uv_pipe_init(&server->m_loop, &connection->pipe, 0);
+    connection->pipe.data = connection;
+    auto stream = reinterpret_cast<uv_stream_t*>(&connection->pipe);
+    if (uv_accept(listener, stream) != 0)
+    {
+        Connection::close(reinterpret_cast<uv_handle_t*>(stream));
+        return;
+    }
+    uv_read_start(stream, allocBuffer, onRead);
+}
+
+void CompileServer::onRead(uv_stream_t* stream, ssize_t numRead, const uv_buf_t* buf)
+{
+    auto connection = static_cast<Connection*>(stream->data);
+    if (numRead > 0)
+    {
+        connection->request.append(buf->base, numRead);
+    }
+    delete[] buf->base;
+
+    if (numRead < 0)
+    {
+        // The client hung up before finishing its request
+        Connection::close(reinterpret_cast<uv_handle_t*>(stream));
+        return;
+    }
+    if (connection->request.find("\n\n") == string::npos)
+    {
+        return;
+    }
+
+    uv_read_stop(stream);
+    connection->response = connection->server->handleRequest(connection->request);
+    auto out = uv_buf_init(&connection->response[0],
+                           static_cast<unsigned int>(connection->response.size()));
+    uv_write(&connection->write, stream, &out, 1, [](uv_write_t* write, int status) {
+        if (status < 0)
+        {
+            logw << "Could not send the response: " << uv_strerror(status);
+        }
+        Connection::close(reinterpret_cast<uv_handle_t*>(write->handle));
+    });
+}
+
+void CompileServer::onSignal(uv_signal_t* signal, int signum)
+{
+    logi << "Stopping on signal " << signum;
+    uv_stop(signal->loop);
+}
+
+string CompileServer::handleRequest(const string& request)
+{
+    auto start = std::chrono::steady_clock::now();
+    istringstream in(request);
+    string cwd;
+    getline(in, cwd);
+    vector<string> args;
+    string arg;
+    while (getline(in, arg) && !arg.empty())
+    {
+        args.push_back(arg);
+    }
+
+    ostringstream out;
+    auto exitCode = 1;
+    if (chdir(cwd.c_str()) != 0)
+    {
+        out << "skcd: cannot change directory to " << cwd << std::endl;
+    }
+    else
+    {
+        try
+        {
+            exitCode = runCompilerDriver(args, out, m_llvmContext.get());
+        }
+        catch (const std::exception& e)
+        {
+            out << "error: " << e.what() << std::endl;
+        }
+    }
+
+    ++m_numRequests;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    logi << "Request " << m_numRequests << " in " << cwd << " exited with " << exitCode
+         << " after " << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+         << "us";
+    return to_string(exitCode) + "\n" + out.str();
+}
+
+int runOnCompileServer(const string& socketPath, const vector<string>& args, ostream& out)
+{
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        throw runtime_error("Could not get the working directory");
+    }
+    string request = string(cwd) + "\n";
+    for (const auto& arg : args)
+    {
+        if (arg.empty() || arg.find('\n') != string::npos)
+        {
+            throw runtime_error("Compile server arguments must be non-empty single lines");
+        }
+        if (arg == "--watch")
+        {
+            throw runtime_error("--watch would block the compile server, run it locally");
+        }
+        request += arg + "\n";
+    }
+    request += "\n";
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        throw runtime_error("Compile server socket path is too long: " + socketPath);
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ostringstream ss;
+        ss << "Could not connect to compile server at " << socketPath << ": " << strerror(errno);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw runtime_error(ss.str());
+    }
+
+    for (size_t written = 0; written < request.size();)
+    {
+        auto n = write(fd, request.data() + written, request.size() - written);
+        if (n <= 0)
+        {
+            close(fd);
+            throw runtime_error("Could not send request to compile server");
+        }
+        written += n;
+    }
+
+    string response;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        response.append(buf, n);
+    }
+    close(fd);
+
+    auto newline = response.find('\n');
+    if (newline == string::npos)
+    {
+        throw runtime_error("Compile server closed the connection without a response");
+    }
+    out << response.substr(newline + 1);
+    return std::stoi(response.substr(0, newline));
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <uv.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+class LLVMContext;
+}
+
+namespace sk
+{
+/**
+ * $XDG_RUNTIME_DIR/skcd.sock, or a per user socket in /tmp
+ */
+std::string getDefaultCompileServerSocket();
+
+/**
+ * CompileServer
+ *
+ * Keeps LLVM initialized and an LLVMContext warm, and runs skc requests from a Unix domain
+ * socket on a libuv loop. A request is the client's working directory and then one argument per
+ * line, ended by an empty line. The response is the exit code on the first line followed by
+ * everything skc printed. Requests are handled one at a time since each one changes the working
+ * directory of the server
+ */
+class CompileServer
+{
+public:
+    CompileServer(const std::string& socketPath);
+    ~CompileServer();
+
+    /**
+     * Serves requests until SIGINT or SIGTERM
+     */
+    void run();
+
+private:
+    struct Connection;
+
+    static void onConnection(uv_stream_t* listener, int status);
+    static void onRead(uv_stream_t* stream, ssize_t numRead, const uv_buf_t* buf);
+    static void onSignal(uv_signal_t* signal, int signum);
+    std::string handleRequest(const std::string& request);
+
+    const std::string m_socketPath;
+    uv_loop_t m_loop;
+    uv_pipe_t m_listener;
+    uv_signal_t m_sigint;
+    uv_signal_t m_sigterm;
+    const std::unique_ptr<llvm::LLVMContext> m_llvmContext;
+    size_t m_numRequests = 0;
+};
+
+/**
+ * Sends an skc request to a running CompileServer, copies its output to out and returns the
+ * exit code of the compile
+ */
+int runOnCompileServer(const std::string& socketPath, const std::vector<std::string>& args,
+                       std::ostream& out);
+}
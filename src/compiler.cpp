@@ -1,20 +1,16 @@
 #include "compiler.hpp"
-#include "ast_printer.hpp"
+#include "llvm_backend.hpp"
 #include "util/logger.hpp"
-#include <llvm/IR/LegacyPassManager.h>
-#include <llvm/Support/FileSystem.h>
-#include <llvm/Support/Host.h>
-#include <llvm/Support/raw_ostream.h>
-#include <llvm/Support/TargetRegistry.h>
-#include <llvm/Support/TargetSelect.h>
-#include <llvm/Target/TargetMachine.h>
-#include <llvm/Target/TargetOptions.h>
+#include "util/trace.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <exception>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <regex>
+#include <thread>
 
-using sk::AstPrinter;
 using sk::CodeGen;
 using sk::Lexer;
 using sk::Module;
@@ -30,105 +26,172 @@ using std::string;
 
 namespace
 {
-void initLlvmTargets()
-{
-    static bool hasRun = false;
-    if (!hasRun)
-    {
-        hasRun = true;
-
-        llvm::InitializeAllTargetInfos();
-        llvm::InitializeAllTargets();
-        llvm::InitializeAllTargetMCs();
-        llvm::InitializeAllAsmParsers();
-        llvm::InitializeAllAsmPrinters();
-    }
-}
+// Top-level expressions in flight between the parser and codegen
+constexpr size_t topLevelQueueSize = 64;
 }
 
 namespace sk
 {
-Compiler::Compiler(const char* filename)
+Compiler::Compiler(const char* filename, const CompilerOptions& options)
     : m_filename(filename),
-      m_source(SourceBuffer::readFile(filename)),
-      m_lexer(m_source),
-      m_module(filename),
-      m_parser(m_module, m_lexer),
-      m_codeGen(filename)
+      m_options(options),
+      m_llvmContextOwner(new llvm::LLVMContext()),
+      m_llvmContext(*m_llvmContextOwner),
+      m_frontendOwner(Frontend::read(filename, options.timeReport)),
+      m_frontend(*m_frontendOwner),
+      m_codeGen(filename, m_llvmContext, options.instrument)
 {
     initLlvmTargets();
 }
 
-void Compiler::compile()
+Compiler::Compiler(const char* filename, llvm::LLVMContext& llvmContext,
+                   const CompilerOptions& options)
+    : m_filename(filename),
+      m_options(options),
+      m_llvmContextOwner(nullptr),
+      m_llvmContext(llvmContext),
+      m_frontendOwner(Frontend::read(filename, options.timeReport)),
+      m_frontend(*m_frontendOwner),
+      m_codeGen(filename, m_llvmContext, options.instrument)
 {
-    m_parser.parse();
-    m_codeGen.dispatch(m_module);
+    initLlvmTargets();
 }
 
-void Compiler::printAst(ostream& os)
+Compiler::Compiler(Frontend& frontend, const CompilerOptions& options)
+    : m_filename(frontend.getFilename()),
+      m_options(options),
+      m_llvmContextOwner(new llvm::LLVMContext()),
+      m_llvmContext(*m_llvmContextOwner),
+      m_frontendOwner(nullptr),
+      m_frontend(frontend),
+      m_codeGen(m_filename, m_llvmContext, options.instrument)
 {
-    AstPrinter printer(os);
-    printer.dispatch(m_module);
+    initLlvmTargets();
 }
 
-void Compiler::buildObjectFile()
+Compiler::Compiler(Frontend& frontend, llvm::LLVMContext& llvmContext,
+                   const CompilerOptions& options)
+    : m_filename(frontend.getFilename()),
+      m_options(options),
+      m_llvmContextOwner(nullptr),
+      m_llvmContext(llvmContext),
+      m_frontendOwner(nullptr),
+      m_frontend(frontend),
+      m_codeGen(m_filename, m_llvmContext, options.instrument)
 {
-    // Write .o files
-    auto objFilename = regex_replace(m_filename, regex("sk$"), "o");
+    initLlvmTargets();
+}
 
-    std::error_code err;
-    llvm::raw_fd_ostream outFile(objFilename, err, llvm::sys::fs::F_RW);
-    if (err)
+void Compiler::compile()
+{
+    TraceSpan span("compile", m_filename);
+    auto timeReport = m_options.timeReport;
+    // A shared Frontend has been parsed already
+    if (m_frontendOwner && !timeReport &&
+        m_frontend.getSource().size() >= m_options.pipelineMinBytes)
     {
-        ostringstream ss;
-        ss << "Failed to open file: " << err.message();
-        throw runtime_error(ss.str());
+        compilePipelined();
     }
-    auto targetTriple = llvm::sys::getDefaultTargetTriple();
-    string targetLookupError;
-    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, targetLookupError);
-    if (!target)
+    else
     {
-        loge << targetLookupError;
-        throw runtime_error("Failed to lookup target triple");
+        if (m_frontendOwner && timeReport)
+        {
+            m_frontend.parse(*timeReport);
+        }
+        else if (m_frontendOwner)
+        {
+            m_frontend.parse();
+        }
+        TimePhase phase(timeReport, "codegen");
+        m_codeGen.dispatch(m_frontend.getModule());
+        if (timeReport)
+        {
+            phase.setCount(countInstructions(m_codeGen.getLlvmModule()), "IR instructions");
+        }
     }
+    TimePhase phase(timeReport, "optimize");
+    optimizeModule(m_codeGen.getLlvmModule(), m_options);
+    if (timeReport)
+    {
+        phase.setCount(countInstructions(m_codeGen.getLlvmModule()), "IR instructions");
+    }
+}
 
-    auto CPU = "generic";
-    auto Features = "";
-
-    llvm::TargetOptions options;
-    auto rm = llvm::Optional<llvm::Reloc::Model>();
-    auto targetMachine = target->createTargetMachine(targetTriple, CPU, Features, options, rm);
-
-    m_codeGen.getLlvmModule().setDataLayout(targetMachine->createDataLayout());
-    m_codeGen.getLlvmModule().setTargetTriple(targetTriple);
-
-    llvm::legacy::PassManager pass;
-    auto fileType = llvm::TargetMachine::CGFT_ObjectFile;
+void Compiler::compilePipelined()
+{
+    // Lexing, parsing and codegen overlap, a function is generated while the ones after it are
+    // still being lexed. Optimization needs the whole module so it still runs afterwards
+    SpscQueue<Expr*> topLevelExprs(topLevelQueueSize);
+    std::exception_ptr parseError;
+    std::thread parseThread([this, &topLevelExprs, &parseError] {
+        try
+        {
+            m_frontend.parse(topLevelExprs);
+        }
+        catch (...)
+        {
+            parseError = std::current_exception();
+        }
+    });
+
+    std::exception_ptr codeGenError;
+    try
+    {
+        m_codeGen.beginModule();
+        while (auto expr = topLevelExprs.pop())
+        {
+            m_codeGen.addTopLevelExpr(*expr);
+        }
+    }
+    catch (...)
+    {
+        codeGenError = std::current_exception();
+        topLevelExprs.close();
+    }
+    parseThread.join();
 
-    if (targetMachine->addPassesToEmitFile(pass, outFile, fileType))
+    if (parseError)
+    {
+        std::rethrow_exception(parseError);
+    }
+    if (codeGenError)
     {
-        throw runtime_error("TargetMachine can't emit a file of this type");
+        std::rethrow_exception(codeGenError);
     }
+    m_codeGen.finishModule(m_frontend.getModule());
+}
+
+void Compiler::printAst(ostream& os)
+{
+    m_frontend.printAst(os);
+}
 
-    pass.run(m_codeGen.getLlvmModule());
-    outFile.flush();
+void Compiler::buildObjectFile()
+{
+    // Write .o files
+    TimePhase phase(m_options.timeReport, "emit");
+    writeObjectFile(m_codeGen.getLlvmModule(), getOutputFilename("o"), m_options.optLevel);
 }
 
 void Compiler::buildLlFile()
 {
-    auto outFilename = regex_replace(m_filename, regex("sk$"), "ll");
+    TimePhase phase(m_options.timeReport, "emit");
+    writeLlFile(m_codeGen.getLlvmModule(), getOutputFilename("ll"));
+}
 
-    std::error_code err;
-    llvm::raw_fd_ostream outFile(outFilename, err, llvm::sys::fs::F_RW);
-    if (err)
+void Compiler::buildBcFile()
+{
+    TimePhase phase(m_options.timeReport, "emit");
+    writeBcFile(m_codeGen.getLlvmModule(), getOutputFilename("bc"),
+                m_options.lto == LtoMode::THIN);
+}
+
+string Compiler::getOutputFilename(const char* extension) const
+{
+    if (!m_options.outputPath.empty())
     {
-        ostringstream ss;
-        ss << "Failed to open file: " << err.message();
-        throw runtime_error(ss.str());
+        return m_options.outputPath;
     }
-
-    m_codeGen.getLlvmModule().print(outFile, nullptr);
-
+    return regex_replace(m_filename, regex("sk$"), extension);
+}
 }
-}
\ No newline at end of file
@@ -1,31 +1,99 @@
 #pragma once
 #include "code_gen.hpp"
-#include "source.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
+#include "frontend.hpp"
 #include "util/string_view.hpp"
+#include "util/time_report.hpp"
 #include <ostream>
 #include <memory>
+#include <string>
+
+namespace llvm
+{
+class LLVMContext;
+class Module;
+}
 
 namespace sk
 {
+enum class LtoMode
+{
+    NONE,
+    // Link in memory, then optimize the whole program as one module
+    FULL,
+    // Write bitcode with a module summary for a ThinLTO capable linker
+    THIN
+};
+
+struct CompilerOptions
+{
+    // 0-3, same meaning as clang's -O levels
+    int optLevel = 0;
+
+    // Instrument the output to write a raw profile on exit. The object has to be linked with the
+    // LLVM profile runtime (clang -fprofile-generate) and the raw profile merged with
+    // llvm-profdata before it can be used
+    bool profileGenerate = false;
+    std::string profileGeneratePath;
+
+    // Indexed profile used to attach branch weights and entry counts. It has to come from a
+    // build with the same optLevel so the CFGs match
+    std::string profileUsePath;
+
+    // Call __sk_prof_enter and __sk_prof_exit around every function, for a profile without perf.
+    // The program has to be linked with the skprof runtime from sklib, which prints a flat and a
+    // call graph profile on exit
+    bool instrument = false;
+
+    LtoMode lto = LtoMode::NONE;
+
+    // Defaults to the input filename with the extension of the artifact
+    std::string outputPath;
+
+    // Sources at least this large are lexed, parsed and code generated as concurrent stages.
+    // Smaller ones aren't worth the threads
+    size_t pipelineMinBytes = 256 * 1024;
+
+    // Receives the timing of every phase when set. The phases have to run one after the other
+    // to be timed, so this turns off the pipeline
+    TimeReport* timeReport = nullptr;
+};
+
 class Compiler
 {
 public:
-    Compiler(const char* filename);
+    Compiler(const char* filename, const CompilerOptions& options = CompilerOptions());
+    /**
+     * Generates code into a shared context, so the result can be linked with other modules
+     */
+    Compiler(const char* filename, llvm::LLVMContext& llvmContext,
+             const CompilerOptions& options = CompilerOptions());
+    /**
+     * Generates code from a Frontend that has already parsed its file, so other backends can
+     * share the parse
+     */
+    Compiler(Frontend& frontend, const CompilerOptions& options = CompilerOptions());
+    Compiler(Frontend& frontend, llvm::LLVMContext& llvmContext,
+             const CompilerOptions& options = CompilerOptions());
 
     void compile();
     void printAst(std::ostream& out);
 
     void buildObjectFile();
     void buildLlFile();
+    void buildBcFile();
+
+    std::unique_ptr<llvm::Module> takeLlvmModule() { return m_codeGen.takeLlvmModule(); }
 
 private:
+    void compilePipelined();
+    std::string getOutputFilename(const char* extension) const;
+
     const char* const m_filename;
-    SourceBuffer m_source;
-    Lexer m_lexer;
-    Module m_module;
-    Parser m_parser;
+    const CompilerOptions m_options;
+    const std::unique_ptr<llvm::LLVMContext> m_llvmContextOwner;
+    llvm::LLVMContext& m_llvmContext;
+    const std::unique_ptr<Frontend> m_frontendOwner;
+    Frontend& m_frontend;
     CodeGen m_codeGen;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,100 @@
+/**
+ * Counting replacements for the global allocation functions, for the allocations in --time-report
+ *
+ * Replacing operator new affects every allocation of the program, so this is linked into the
+ * executables that report allocations instead of the skiff library. The nothrow and array forms
+ * of new and the sized forms of delete forward to these
+ */
+#include "util/time_report.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Plain thread_local counter, so counting costs an add and no synchronization
+thread_local size_t threadAllocatedBytes = 0;
+
+size_t getCountedBytes()
+{
+    return threadAllocatedBytes;
+}
+
+// Linking this file is what turns counting on
+const bool registered = (sk::setAllocatedBytesCounter(getCountedBytes), true);
+}
+
+void* operator new(size_t size)
+{
+    threadAllocatedBytes += size;
+    if (auto p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned types in code built as C++17, LLVM's among them
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    threadAllocatedBytes += size;
+    void* p = nullptr;
+    if (posix_memalign(&p, std::max(static_cast<size_t>(alignment), sizeof(void*)),
+                       size ? size : 1) == 0)
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#endif
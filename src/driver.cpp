@@ -0,0 +1,448 @@
+#include "driver.hpp"
+#include "compiler.hpp"
+#include "frontend.hpp"
+#include "module_linker.hpp"
+#include "wasm_compiler.hpp"
+#include "watcher.hpp"
+#include "util/logger.hpp"
+#include "util/thread_pool.hpp"
+#include "util/trace.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <thread>
+
+using std::endl;
+using std::ofstream;
+using std::ostream;
+using std::ostringstream;
+using std::regex;
+using std::regex_replace;
+using std::strcmp;
+using std::strlen;
+using std::strncmp;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace sk
+{
+namespace
+{
+enum class EmitKind
+{
+    LL,
+    BC,
+    OBJ
+};
+
+enum class TimeReportFormat
+{
+    NONE,
+    TABLE,
+    JSON
+};
+
+void printUsage(ostream& out)
+{
+    out << "USAGE: skc [-s] [-O<0-3>] [-j<jobs>] [--emit=ll|bc|obj] [-o output] "
+           "[--profile-generate[=file.profraw]] [--profile-use=file.profdata] "
+           "[--instrument] [--link] [--runtime=lib.bc] [--lto=full|thin] [--wasm] [--watch] "
+           "[--time-report[=json]] [--trace=out.json] file.sk...\n"
+           "       skc --connect[=socket] <skc arguments>"
+        << endl;
+}
+
+/**
+ * Traces everything until it goes out of scope, then writes the trace to filename. Does nothing
+ * when filename is empty
+ */
+class TraceWriter
+{
+public:
+    TraceWriter(const string& filename) : m_filename(filename)
+    {
+        if (!m_filename.empty())
+        {
+            startTracing();
+        }
+    }
+    ~TraceWriter()
+    {
+        if (m_filename.empty())
+        {
+            return;
+        }
+        stopTracing();
+        ofstream out(m_filename);
+        writeTrace(out);
+        if (!out)
+        {
+            loge << "Could not write trace to " << m_filename;
+        }
+    }
+    void operator=(const TraceWriter&) = delete;
+    TraceWriter(const TraceWriter&) = delete;
+
+private:
+    const string m_filename;
+};
+
+template <typename Builder>
+void build(Builder& builder, EmitKind emit)
+{
+    switch (emit)
+    {
+        case EmitKind::LL:
+            builder.buildLlFile();
+            break;
+        case EmitKind::BC:
+            builder.buildBcFile();
+            break;
+        case EmitKind::OBJ:
+            builder.buildObjectFile();
+            break;
+    }
+}
+
+/**
+ * Builds the native artifact and a .wasm from a single parse, with the two backends running on
+ * separate threads
+ */
+void buildNativeAndWasm(const char* inFilename, const CompilerOptions& options, EmitKind emit,
+                        ostream& out)
+{
+    Frontend frontend(inFilename);
+    frontend.parse();
+    frontend.printAst(out);
+    out << endl;
+
+    WasmCompilerOptions wasmOptions;
+    wasmOptions.optLevel = options.optLevel;
+    WasmCompiler wasmCompiler(frontend, wasmOptions);
+    std::exception_ptr wasmError;
+    std::thread wasmThread([&wasmCompiler, &wasmError] {
+        try
+        {
+            wasmCompiler.compile();
+            wasmCompiler.buildWasmFile();
+        }
+        catch (...)
+        {
+            wasmError = std::current_exception();
+        }
+    });
+
+    std::exception_ptr nativeError;
+    try
+    {
+        Compiler compiler(frontend, options);
+        compiler.compile();
+        build(compiler, emit);
+    }
+    catch (...)
+    {
+        nativeError = std::current_exception();
+    }
+    wasmThread.join();
+
+    if (nativeError)
+    {
+        std::rethrow_exception(nativeError);
+    }
+    if (wasmError)
+    {
+        std::rethrow_exception(wasmError);
+    }
+}
+
+/**
+ * Compiles one file, printing its AST and time report to out
+ */
+void buildFile(const char* inFilename, CompilerOptions options, EmitKind emit, bool alsoWasm,
+               TimeReportFormat timeReportFormat, ostream& out, llvm::LLVMContext* llvmContext)
+{
+    if (alsoWasm)
+    {
+        buildNativeAndWasm(inFilename, options, emit, out);
+        return;
+    }
+
+    TraceSpan span("build", inFilename);
+    TimeReport timeReport(inFilename);
+    if (timeReportFormat != TimeReportFormat::NONE)
+    {
+        options.timeReport = &timeReport;
+    }
+
+    logd << "Building compiler";
+    auto compiler = llvmContext
+                        ? unique_ptr<Compiler>(new Compiler(inFilename, *llvmContext, options))
+                        : unique_ptr<Compiler>(new Compiler(inFilename, options));
+
+    logd << "compiling...";
+    compiler->compile();
+
+    logd << "done compiling";
+    compiler->printAst(out);
+    out << endl;
+
+    build(*compiler, emit);
+
+    if (timeReportFormat == TimeReportFormat::TABLE)
+    {
+        timeReport.printTable(out);
+    }
+    else if (timeReportFormat == TimeReportFormat::JSON)
+    {
+        timeReport.printJson(out);
+    }
+}
+
+/**
+ * Compiles every file, on the pool when there is one. Output and errors are printed in input
+ * order whatever order the files finish in
+ */
+int buildFiles(const vector<const char*>& inFilenames, const CompilerOptions& options,
+               EmitKind emit, bool alsoWasm, TimeReportFormat timeReportFormat, ostream& out,
+               ThreadPool* pool, llvm::LLVMContext* llvmContext)
+{
+    vector<ostringstream> outputs(inFilenames.size());
+    vector<string> errors(inFilenames.size());
+    for (size_t i = 0; i < inFilenames.size(); ++i)
+    {
+        auto task = [&, i] {
+            try
+            {
+                buildFile(inFilenames[i], options, emit, alsoWasm, timeReportFormat, outputs[i],
+                          llvmContext);
+            }
+            catch (const std::exception& e)
+            {
+                errors[i] = e.what();
+            }
+        };
+        if (pool)
+        {
+            pool->submit(task);
+        }
+        else
+        {
+            task();
+        }
+    }
+    if (pool)
+    {
+        pool->wait();
+    }
+
+    size_t numFailed = 0;
+    for (size_t i = 0; i < inFilenames.size(); ++i)
+    {
+        out << outputs[i].str();
+        if (!errors[i].empty())
+        {
+            out << inFilenames[i] << ": error: " << errors[i] << endl;
+            ++numFailed;
+        }
+    }
+    if (numFailed > 1)
+    {
+        out << numFailed << " of " << inFilenames.size() << " files failed" << endl;
+    }
+    return numFailed == 0 ? 0 : 1;
+}
+}
+
+int runCompilerDriver(const vector<string>& args, ostream& out, llvm::LLVMContext* llvmContext)
+{
+    if (args.empty())
+    {
+        printUsage(out);
+        return 1;
+    }
+
+    CompilerOptions options;
+    auto emit = EmitKind::LL;
+    auto linkInMemory = false;
+    auto alsoWasm = false;
+    auto watch = false;
+    auto timeReportFormat = TimeReportFormat::NONE;
+    string tracePath;
+    size_t numJobs = 0;
+    vector<const char*> runtimeFiles;
+    vector<const char*> inFilenames;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const char* arg = args[i].c_str();
+        if (arg[0] != '-')
+        {
+            inFilenames.push_back(arg);
+        }
+        else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--emit=obj") == 0)
+        {
+            emit = EmitKind::OBJ;
+        }
+        else if (strcmp(arg, "--emit=ll") == 0)
+        {
+            emit = EmitKind::LL;
+        }
+        else if (strcmp(arg, "--emit=bc") == 0)
+        {
+            emit = EmitKind::BC;
+        }
+        else if (strcmp(arg, "-o") == 0 && i + 1 < args.size())
+        {
+            options.outputPath = args[++i];
+        }
+        else if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '3')
+        {
+            options.optLevel = arg[2] - '0';
+        }
+        else if (strncmp(arg, "-j", 2) == 0 && std::atoi(arg + 2) > 0)
+        {
+            numJobs = std::atoi(arg + 2);
+        }
+        else if (strcmp(arg, "--profile-generate") == 0)
+        {
+            options.profileGenerate = true;
+        }
+        else if (strncmp(arg, "--profile-generate=", 19) == 0)
+        {
+            options.profileGenerate = true;
+            options.profileGeneratePath = arg + 19;
+        }
+        else if (strncmp(arg, "--profile-use=", 14) == 0)
+        {
+            options.profileUsePath = arg + 14;
+        }
+        else if (strcmp(arg, "--instrument") == 0)
+        {
+            options.instrument = true;
+        }
+        else if (strcmp(arg, "--link") == 0)
+        {
+            linkInMemory = true;
+        }
+        else if (strncmp(arg, "--runtime=", 10) == 0)
+        {
+            runtimeFiles.push_back(arg + 10);
+        }
+        else if (strcmp(arg, "--lto=full") == 0)
+        {
+            options.lto = LtoMode::FULL;
+            linkInMemory = true;
+        }
+        else if (strcmp(arg, "--wasm") == 0)
+        {
+            alsoWasm = true;
+        }
+        else if (strcmp(arg, "--watch") == 0)
+        {
+            watch = true;
+        }
+        else if (strcmp(arg, "--time-report") == 0)
+        {
+            timeReportFormat = TimeReportFormat::TABLE;
+        }
+        else if (strcmp(arg, "--time-report=json") == 0)
+        {
+            timeReportFormat = TimeReportFormat::JSON;
+        }
+        else if (strncmp(arg, "--trace=", 8) == 0 && arg[8])
+        {
+            tracePath = arg + 8;
+        }
+        else if (strcmp(arg, "--lto=thin") == 0)
+        {
+            // The summary is written into the bitcode and the system linker does the rest
+            options.lto = LtoMode::THIN;
+            emit = EmitKind::BC;
+        }
+        else
+        {
+            printUsage(out);
+            return 1;
+        }
+    }
+    if (inFilenames.empty() || (!runtimeFiles.empty() && !linkInMemory) ||
+        (!options.outputPath.empty() && inFilenames.size() > 1 && !linkInMemory) ||
+        (alsoWasm && (linkInMemory || options.instrument)) || (watch && (linkInMemory || alsoWasm)) ||
+        (timeReportFormat != TimeReportFormat::NONE && (linkInMemory || alsoWasm || watch)) ||
+        (!tracePath.empty() && watch))
+    {
+        printUsage(out);
+        return 1;
+    }
+
+    TraceWriter traceWriter(tracePath);
+
+    if (linkInMemory)
+    {
+        logd << "Linking " << inFilenames.size() << " files";
+        auto linkedName = regex_replace(inFilenames.front(), regex("\\.sk$"), "");
+        // Errors are reported against the file being added, or the linked module after that
+        string current;
+        try
+        {
+            ModuleLinker linker(linkedName, options);
+            for (auto inFilename : inFilenames)
+            {
+                current = inFilename;
+                linker.addSourceFile(inFilename, &out);
+            }
+            for (auto runtimeFile : runtimeFiles)
+            {
+                current = runtimeFile;
+                linker.addIrFile(runtimeFile);
+            }
+            current = linkedName;
+            linker.link();
+            build(linker, emit);
+        }
+        catch (const std::exception& e)
+        {
+            out << current << ": error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (watch)
+    {
+        // Targets are initialized and the context stays warm across rebuilds
+        unique_ptr<llvm::LLVMContext> watchContext;
+        if (!llvmContext)
+        {
+            watchContext.reset(new llvm::LLVMContext());
+            llvmContext = watchContext.get();
+        }
+        Watcher watcher(inFilenames,
+                        [&](Frontend& frontend) {
+                            Compiler compiler(frontend, *llvmContext, options);
+                            compiler.compile();
+                            build(compiler, emit);
+                        },
+                        out);
+        watcher.run();
+        return 0;
+    }
+
+    if (inFilenames.size() == 1)
+    {
+        return buildFiles(inFilenames, options, emit, alsoWasm, timeReportFormat, out, nullptr,
+                          llvmContext);
+    }
+    // Tasks can't share a context, each file gets its own
+    ThreadPool pool(std::min<size_t>(numJobs ? numJobs : std::thread::hardware_concurrency(),
+                                     inFilenames.size()));
+    return buildFiles(inFilenames, options, emit, alsoWasm, timeReportFormat, out, &pool,
+                      nullptr);
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+class LLVMContext;
+}
+
+namespace sk
+{
+/**
+ * Runs skc with the given arguments, not including the program name, and returns its exit code.
+ * The AST and usage are printed to out. Single file compiles use llvmContext when it is given,
+ * so a long running process can keep one warm across requests
+ */
+int runCompilerDriver(const std::vector<std::string>& args, std::ostream& out,
+                      llvm::LLVMContext* llvmContext = nullptr);
+}
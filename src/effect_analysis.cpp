@@ -0,0 +1,252 @@
+#include "effect_analysis.hpp"
+#include "util/logger.hpp"
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+using std::map;
+using std::max;
+using std::ostream;
+using std::runtime_error;
+
+namespace
+{
+using sk::Effect;
+using sk::string_view;
+
+struct Builtin
+{
+    Effect effect;
+    bool noUnwind;
+    bool willReturn;
+};
+
+// Add new builtins here as CodeGen learns about them
+const map<string_view, Builtin> builtins = {
+    {"puts", {Effect::SIDE_EFFECT, true, true}}
+};
+
+enum VisitState
+{
+    NOT_VISITED = 0,
+    IN_PROGRESS,
+    DONE
+};
+}
+
+namespace sk
+{
+ostream& operator<<(ostream& os, Effect effect)
+{
+    switch (effect)
+    {
+        case Effect::PURE:
+            os << "PURE";
+            break;
+        case Effect::READ_ONLY:
+            os << "READ_ONLY";
+            break;
+        case Effect::SIDE_EFFECT:
+            os << "SIDE_EFFECT";
+            break;
+    }
+    return os;
+}
+
+void EffectAnalysis::visit(Module& module)
+{
+    logi << "EffectAnalysis::visit module";
+    dispatch(module.getMainBlock());
+    propagate();
+}
+
+void EffectAnalysis::visit(Block& block)
+{
+    for (auto& e : block.getExpressions())
+    {
+        dispatch(e);
+    }
+}
+
+void EffectAnalysis::visit(LetExpr& expr)
+{
+    dispatch(expr.getExpr());
+}
+
+void EffectAnalysis::visit(Expr& expr)
+{
+}
+
+void EffectAnalysis::visit(Function& func)
+{
+    auto name = func.getName();
+    m_functionNames[&func] = name;
+    auto& summary = m_summaries[name];
+    summary = Summary();
+
+    m_summaryStack.push_back(&summary);
+    dispatch(func.getBlock());
+    m_summaryStack.pop_back();
+}
+
+void EffectAnalysis::visit(FunctionCall& call)
+{
+    if (!m_summaryStack.empty())
+    {
+        m_summaryStack.back()->callees.insert(call.getId().getName());
+    }
+    for (auto& arg : call.getArguments())
+    {
+        dispatch(arg);
+    }
+}
+
+void EffectAnalysis::visit(Identifier& variable)
+{
+}
+
+void EffectAnalysis::visit(I32Literal& i32Literal)
+{
+}
+
+void EffectAnalysis::visit(StringLiteral& str)
+{
+    // String literals are constant globals, taking their address doesn't touch memory
+}
+
+void EffectAnalysis::visit(BinaryOp& binOp)
+{
+    dispatch(binOp.getLhs());
+    dispatch(binOp.getRhs());
+}
+
+void EffectAnalysis::visit(IfExpr& expr)
+{
+    dispatch(*expr.getCondition());
+    dispatch(*expr.getThenBlock());
+    dispatch(*expr.getElseBlock());
+}
+
+void EffectAnalysis::visit(Match& match)
+{
+}
+
+void EffectAnalysis::visit(IdMatch& match)
+{
+}
+
+void EffectAnalysis::visit(TupleMatch& match)
+{
+}
+
+void EffectAnalysis::visit(TypeMatch& match)
+{
+}
+
+Effect EffectAnalysis::getEffect(const Function& func) const
+{
+    return getSummary(func).effect;
+}
+
+bool EffectAnalysis::isNoUnwind(const Function& func) const
+{
+    return getSummary(func).noUnwind;
+}
+
+bool EffectAnalysis::willReturn(const Function& func) const
+{
+    return getSummary(func).willReturn;
+}
+
+void EffectAnalysis::propagate()
+{
+    // Effects of direct callees, then effects of callees of callees until nothing changes. The
+    // lattice is finite and effects only grow, so this terminates even for recursive functions
+    for (auto changed = true; changed;)
+    {
+        changed = false;
+        for (auto& entry : m_summaries)
+        {
+            auto& summary = entry.second;
+            for (auto& callee : summary.callees)
+            {
+                auto effect = Effect::SIDE_EFFECT;
+                auto noUnwind = false;
+                auto calleeSummary = m_summaries.find(callee);
+                if (calleeSummary != m_summaries.end())
+                {
+                    effect = calleeSummary->second.effect;
+                    noUnwind = calleeSummary->second.noUnwind;
+                }
+                else
+                {
+                    auto builtin = builtins.find(callee);
+                    if (builtin != builtins.end())
+                    {
+                        effect = builtin->second.effect;
+                        noUnwind = builtin->second.noUnwind;
+                    }
+                }
+
+                if (effect > summary.effect)
+                {
+                    summary.effect = effect;
+                    changed = true;
+                }
+                if (summary.noUnwind && !noUnwind)
+                {
+                    summary.noUnwind = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    map<string_view, int> visitState;
+    for (auto& entry : m_summaries)
+    {
+        computeWillReturn(entry.first, visitState);
+    }
+}
+
+bool EffectAnalysis::computeWillReturn(string_view name, map<string_view, int>& visitState)
+{
+    auto summary = m_summaries.find(name);
+    if (summary == m_summaries.end())
+    {
+        auto builtin = builtins.find(name);
+        return builtin != builtins.end() && builtin->second.willReturn;
+    }
+
+    auto& state = visitState[name];
+    if (state == IN_PROGRESS)
+    {
+        // Recursion, Skiff has no loops so this is the only way not to return
+        return false;
+    }
+    if (state == DONE)
+    {
+        return summary->second.willReturn;
+    }
+
+    state = IN_PROGRESS;
+    auto willReturn = true;
+    for (auto& callee : summary->second.callees)
+    {
+        willReturn = computeWillReturn(callee, visitState) && willReturn;
+    }
+    summary->second.willReturn = willReturn;
+    visitState[name] = DONE;
+    return willReturn;
+}
+
+const EffectAnalysis::Summary& EffectAnalysis::getSummary(const Function& func) const
+{
+    auto name = m_functionNames.find(&func);
+    if (name == m_functionNames.end())
+    {
+        throw runtime_error("EffectAnalysis has not seen function");
+    }
+    return m_summaries.at(name->second);
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "ast.hpp"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace sk
+{
+/**
+ * What a function may do besides computing its result, ordered from least to most restrictive
+ * for the optimizer
+ */
+enum class Effect
+{
+    PURE,
+    READ_ONLY,
+    SIDE_EFFECT
+};
+std::ostream& operator<<(std::ostream& os, Effect effect);
+
+/**
+ * EffectAnalysis
+ *
+ * Classifies every Function in a Module by the effects of its body and everything it calls.
+ * Builtins have known effects, calls to anything else that isn't defined in the module are
+ * assumed to have side effects.
+ */
+class EffectAnalysis : public AstVisitor
+{
+public:
+    void visit(Module& module) override;
+    void visit(Block& block) override;
+    void visit(LetExpr& expr) override;
+    void visit(Expr& expr) override;
+    void visit(Function& func) override;
+    void visit(FunctionCall& call) override;
+    void visit(Identifier& variable) override;
+    void visit(I32Literal& i32Literal) override;
+    void visit(StringLiteral& str) override;
+    void visit(BinaryOp& binOp) override;
+    void visit(IfExpr& expr) override;
+    void visit(Match& match) override;
+    void visit(IdMatch& match) override;
+    void visit(TupleMatch& match) override;
+    void visit(TypeMatch& match) override;
+
+    Effect getEffect(const Function& func) const;
+    /**
+     * True if the function only calls code that can't unwind
+     */
+    bool isNoUnwind(const Function& func) const;
+    /**
+     * True if the function always returns, i.e. it is not recursive and only calls functions
+     * that always return
+     */
+    bool willReturn(const Function& func) const;
+
+private:
+    struct Summary
+    {
+        Effect effect = Effect::PURE;
+        std::set<string_view> callees;
+        bool noUnwind = true;
+        bool willReturn = true;
+    };
+
+    void propagate();
+    bool computeWillReturn(string_view name, std::map<string_view, int>& visitState);
+    const Summary& getSummary(const Function& func) const;
+
+    // Calls resolve by name, a later definition replaces an earlier one like in CodeGen
+    std::map<string_view, Summary> m_summaries;
+    std::map<const Function*, string_view> m_functionNames;
+    std::vector<Summary*> m_summaryStack;
+};
+}
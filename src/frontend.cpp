@@ -0,0 +1,196 @@
+#include "frontend.hpp"
+#include "ast_printer.hpp"
+#include "util/logger.hpp"
+#include "util/trace.hpp"
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using std::exception_ptr;
+using std::ostream;
+using std::unique_ptr;
+using std::vector;
+
+namespace
+{
+constexpr size_t tokenQueueSize = 4096;
+
+/**
+ * Tokens from the lexer thread. Keeps returning END_OF_INPUT once it has seen it, like a Lexer
+ */
+class QueuedTokenSource : public sk::TokenSource
+{
+public:
+    QueuedTokenSource(sk::SpscQueue<sk::Token>& tokens) : m_tokens(tokens) {}
+
+    sk::Token take() override
+    {
+        if (m_last.getKind() != sk::TokenKind::END_OF_INPUT)
+        {
+            m_last = m_tokens.pop();
+        }
+        return m_last;
+    }
+
+private:
+    sk::SpscQueue<sk::Token>& m_tokens;
+    sk::Token m_last{sk::TokenKind::WHITESPACE, "", 0, 0};
+};
+
+/**
+ * Tokens lexed ahead of time. The last one is END_OF_INPUT and is returned again at the end
+ */
+class VectorTokenSource : public sk::TokenSource
+{
+public:
+    VectorTokenSource(const vector<sk::Token>& tokens) : m_tokens(tokens) {}
+
+    sk::Token take() override
+    {
+        auto& token = m_tokens[m_next];
+        if (m_next + 1 < m_tokens.size())
+        {
+            ++m_next;
+        }
+        return token;
+    }
+
+private:
+    const vector<sk::Token>& m_tokens;
+    size_t m_next = 0;
+};
+}
+
+namespace sk
+{
+Frontend::Frontend(const char* filename)
+    : m_filename(filename),
+      m_source(SourceBuffer::readFile(filename)),
+      m_lexer(m_source),
+      m_module(filename),
+      m_parser(m_module, m_lexer)
+{
+}
+
+Frontend::Frontend(const char* filename, SourceBuffer&& source)
+    : m_filename(filename),
+      m_source(std::move(source)),
+      m_lexer(m_source),
+      m_module(filename),
+      m_parser(m_module, m_lexer)
+{
+}
+
+unique_ptr<Frontend> Frontend::read(const char* filename, TimeReport* timeReport)
+{
+    TimePhase phase(timeReport, "read");
+    auto source = SourceBuffer::readFile(filename);
+    phase.setCount(source.size(), "bytes");
+    return unique_ptr<Frontend>(new Frontend(filename, std::move(source)));
+}
+
+void Frontend::parse()
+{
+    logi << "Parsing " << m_filename;
+    m_parser.parse();
+}
+
+void Frontend::parse(TimeReport& timeReport)
+{
+    logi << "Parsing " << m_filename << " timed";
+    vector<Token> tokens;
+    {
+        TimePhase phase(&timeReport, "lex");
+        TraceSpan span("lex", m_filename);
+        while (true)
+        {
+            auto token = m_lexer.take();
+            if (token.isSignificant())
+            {
+                tokens.push_back(token);
+            }
+            if (token.getKind() == TokenKind::END_OF_INPUT)
+            {
+                break;
+            }
+        }
+        phase.setCount(tokens.size(), "tokens");
+    }
+
+    TimePhase phase(&timeReport, "parse");
+    VectorTokenSource source(tokens);
+    Parser parser(m_module, source);
+    parser.parse();
+    phase.setCount(countNodes(m_module.getMainBlock()), "AST nodes");
+}
+
+void Frontend::parse(SpscQueue<Expr*>& topLevelExprs)
+{
+    logi << "Parsing " << m_filename << " pipelined";
+    SpscQueue<Token> tokens(tokenQueueSize);
+    exception_ptr lexError;
+    std::thread lexThread([this, &tokens, &lexError] {
+        TraceSpan span("lex", m_filename);
+        try
+        {
+            while (true)
+            {
+                auto token = m_lexer.take();
+                if (!token.isSignificant())
+                {
+                    continue;
+                }
+                if (!tokens.push(token) || token.getKind() == TokenKind::END_OF_INPUT)
+                {
+                    return;
+                }
+            }
+        }
+        catch (...)
+        {
+            lexError = std::current_exception();
+            tokens.push(Token(TokenKind::END_OF_INPUT, "", 0, 0));
+        }
+    });
+
+    exception_ptr parseError;
+    try
+    {
+        QueuedTokenSource source(tokens);
+        Parser parser(m_module, source);
+        parser.begin();
+        while (auto expr = parser.parseTopLevelExpr())
+        {
+            if (!topLevelExprs.push(expr))
+            {
+                break;
+            }
+        }
+    }
+    catch (...)
+    {
+        parseError = std::current_exception();
+    }
+    topLevelExprs.push(nullptr);
+
+    // The parser can stop before the end of the input, don't let the lexer wait for it
+    tokens.close();
+    lexThread.join();
+    // A lex error truncates the tokens, so it explains any parse error that follows
+    if (lexError)
+    {
+        std::rethrow_exception(lexError);
+    }
+    if (parseError)
+    {
+        std::rethrow_exception(parseError);
+    }
+}
+
+void Frontend::printAst(ostream& os)
+{
+    AstPrinter printer(os);
+    printer.dispatch(m_module);
+}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "ast.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "util/spsc_queue.hpp"
+#include "util/time_report.hpp"
+#include <memory>
+#include <ostream>
+
+namespace sk
+{
+/**
+ * Frontend
+ *
+ * Reads, lexes and parses one source file. Nothing modifies the Module after parse(), so several
+ * backends can generate code from it, also concurrently.
+ */
+class Frontend
+{
+public:
+    Frontend(const char* filename);
+    /**
+     * Parses source that has already been read from filename
+     */
+    Frontend(const char* filename, SourceBuffer&& source);
+    /**
+     * Reads filename as the "read" phase of timeReport, which can be null
+     */
+    static std::unique_ptr<Frontend> read(const char* filename, TimeReport* timeReport);
+
+    void parse();
+    /**
+     * Lexes the whole file before parsing it, so both are timed as separate phases
+     */
+    void parse(TimeReport& timeReport);
+    /**
+     * Lexes on a second thread while parsing on this one, and pushes each top-level expression
+     * to topLevelExprs as soon as it is parsed. The stream always ends with a nullptr, also when
+     * parsing throws, so a consumer on another thread can overlap its work with parsing
+     */
+    void parse(SpscQueue<Expr*>& topLevelExprs);
+    void printAst(std::ostream& os);
+
+    const char* getFilename() const { return m_filename; }
+    const SourceBuffer& getSource() const { return m_source; }
+    Module& getModule() { return m_module; }
+
+private:
+    const char* const m_filename;
+    SourceBuffer m_source;
+    Lexer m_lexer;
+    Module m_module;
+    Parser m_parser;
+};
+}
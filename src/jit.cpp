@@ -0,0 +1,88 @@
+#include "jit.hpp"
+#include "llvm_backend.hpp"
+#include "perf_jit_listener.hpp"
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+
+namespace sk
+{
+Jit::Jit(bool perf)
+{
+    initLlvmTargets();
+    // So checkSymbols finds functions like puts before the first engine loads the process
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    if (perf)
+    {
+        m_perfListener = std::make_unique<PerfJitListener>();
+    }
+}
+
+Jit::~Jit() = default;
+
+int Jit::runMain(unique_ptr<llvm::Module> module)
+{
+    if (!module->getFunction("main"))
+    {
+        ostringstream ss;
+        ss << "Module " << module->getName().str() << " has no main";
+        throw runtime_error(ss.str());
+    }
+    checkSymbols(*module);
+
+    string error;
+    unique_ptr<llvm::ExecutionEngine> engine(
+        llvm::EngineBuilder(std::move(module))
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setErrorStr(&error)
+            .setMCJITMemoryManager(
+                unique_ptr<llvm::RTDyldMemoryManager>(new llvm::SectionMemoryManager()))
+            .create());
+    if (!engine)
+    {
+        ostringstream ss;
+        ss << "Failed to create JIT: " << error;
+        throw runtime_error(ss.str());
+    }
+    if (m_perfListener)
+    {
+        engine->RegisterJITEventListener(m_perfListener.get());
+    }
+    engine->finalizeObject();
+
+    auto mainFunction =
+        reinterpret_cast<int (*)(int, char**)>(engine->getFunctionAddress("main"));
+    char programName[] = "ski";
+    char* argv[] = {programName, nullptr};
+    auto result = mainFunction(1, argv);
+    if (m_perfListener)
+    {
+        m_engines.push_back(std::move(engine));
+    }
+    return result;
+}
+
+void Jit::checkSymbols(const llvm::Module& module) const
+{
+    for (auto& function : module)
+    {
+        if (function.isDeclaration() && !function.isIntrinsic() && !function.use_empty() &&
+            !llvm::RTDyldMemoryManager::getSymbolAddressInProcess(function.getName().str()))
+        {
+            ostringstream ss;
+            ss << "Undefined function " << function.getName().str();
+            throw runtime_error(ss.str());
+        }
+    }
+}
+}
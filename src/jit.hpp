@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+namespace llvm
+{
+class ExecutionEngine;
+class JITEventListener;
+class Module;
+}
+
+namespace sk
+{
+/**
+ * Jit
+ *
+ * Runs modules in this process with MCJIT. Each module gets its own engine, freed once main
+ * returns unless perf was told about the code, then it is kept until the Jit is destroyed so the
+ * code stays where perf expects it. The engines own the modules, so the Jit has to go before the
+ * LLVMContext they were made in
+ */
+class Jit
+{
+public:
+    /**
+     * perf: tell Linux perf about every compiled function, see PerfJitListener
+     */
+    explicit Jit(bool perf = false);
+    ~Jit();
+
+    /**
+     * Compiles module to machine code and calls its main
+     */
+    int runMain(std::unique_ptr<llvm::Module> module);
+
+    /**
+     * Throws if module calls a function that is neither defined in it nor found in this process,
+     * MCJIT would abort on it while loading the code
+     */
+    void checkSymbols(const llvm::Module& module) const;
+
+private:
+    std::unique_ptr<llvm::JITEventListener> m_perfListener;
+    // Only kept for perf. Destroyed before the listener, engines notify it as they free their code
+    std::vector<std::unique_ptr<llvm::ExecutionEngine>> m_engines;
+};
+}
@@ -73,14 +73,24 @@ int getTokenPrecedence(Token& token);
 std::ostream& operator<<(std::ostream& os, Token token);
 
 
-class Lexer
+/**
+ * Where the Parser takes its tokens from
+ */
+class TokenSource
+{
+public:
+    virtual ~TokenSource() = default;
+    virtual Token take() = 0;
+};
+
+class Lexer : public TokenSource
 {
 public:
     Lexer(string_view sourceStr) noexcept;
     Lexer(std::unique_ptr<SourceBuffer>&& buffer) noexcept;
     Lexer(SourceBuffer& buffer) noexcept;
 
-    Token take();
+    Token take() override;
 
 private:
     const std::unique_ptr<SourceBuffer> m_bufferOwner;
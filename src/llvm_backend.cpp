@@ -0,0 +1,264 @@
+#include "llvm_backend.hpp"
+#include "compiler.hpp"
+#include "util/logger.hpp"
+#include "util/trace.hpp"
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+
+namespace
+{
+unique_ptr<llvm::raw_fd_ostream> openOutputFile(const string& filename)
+{
+    std::error_code err;
+    unique_ptr<llvm::raw_fd_ostream> outFile(
+        new llvm::raw_fd_ostream(filename, err, llvm::sys::fs::F_RW));
+    if (err)
+    {
+        ostringstream ss;
+        ss << "Failed to open file: " << err.message();
+        throw runtime_error(ss.str());
+    }
+    return outFile;
+}
+
+void writeObject(llvm::Module& module, llvm::raw_pwrite_stream& out, int optLevel)
+{
+    auto targetMachine = sk::createTargetMachine(optLevel);
+    module.setDataLayout(targetMachine->createDataLayout());
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+
+    llvm::legacy::PassManager pass;
+    auto fileType = llvm::TargetMachine::CGFT_ObjectFile;
+
+    if (targetMachine->addPassesToEmitFile(pass, out, fileType))
+    {
+        throw runtime_error("TargetMachine can't emit a file of this type");
+    }
+
+    pass.run(module);
+}
+
+void addTargetAnalysis(llvm::legacy::PassManagerBase& passes, llvm::TargetMachine& targetMachine)
+{
+    passes.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+}
+
+llvm::Pass* createInliner(int optLevel)
+{
+    if (optLevel > 0)
+    {
+        // Call site hotness from a profile raises or lowers the inlining threshold
+        return llvm::createFunctionInliningPass(optLevel, 0, false);
+    }
+    return llvm::createAlwaysInlinerLegacyPass();
+}
+}
+
+namespace sk
+{
+void initLlvmTargets()
+{
+    // Compilers are constructed concurrently by skc's thread pool
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+    });
+}
+
+unique_ptr<llvm::TargetMachine> createTargetMachine(int optLevel)
+{
+    auto targetTriple = llvm::sys::getDefaultTargetTriple();
+    string targetLookupError;
+    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, targetLookupError);
+    if (!target)
+    {
+        loge << targetLookupError;
+        throw runtime_error("Failed to lookup target triple");
+    }
+
+    auto CPU = "generic";
+    auto Features = "";
+
+    llvm::TargetOptions options;
+    auto rm = llvm::Optional<llvm::Reloc::Model>();
+    unique_ptr<llvm::TargetMachine> targetMachine(
+        target->createTargetMachine(targetTriple, CPU, Features, options, rm));
+    switch (optLevel)
+    {
+        case 0:
+            targetMachine->setOptLevel(llvm::CodeGenOpt::None);
+            break;
+        case 1:
+            targetMachine->setOptLevel(llvm::CodeGenOpt::Less);
+            break;
+        case 2:
+            targetMachine->setOptLevel(llvm::CodeGenOpt::Default);
+            break;
+        default:
+            targetMachine->setOptLevel(llvm::CodeGenOpt::Aggressive);
+            break;
+    }
+    return targetMachine;
+}
+
+void setHostTarget(llvm::Module& module)
+{
+    auto targetMachine = createTargetMachine(0);
+    module.setDataLayout(targetMachine->createDataLayout());
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+}
+
+size_t countInstructions(const llvm::Module& module)
+{
+    size_t count = 0;
+    for (auto& function : module)
+    {
+        for (auto& block : function)
+        {
+            count += block.size();
+        }
+    }
+    return count;
+}
+
+void optimizeModule(llvm::Module& module, const CompilerOptions& options)
+{
+    if (options.optLevel == 0 && !options.profileGenerate && options.profileUsePath.empty())
+    {
+        return;
+    }
+    logi << "Optimizing " << module.getName().str() << " at -O" << options.optLevel;
+    TraceSpan span("optimize");
+
+    auto targetMachine = createTargetMachine(options.optLevel);
+    module.setDataLayout(targetMachine->createDataLayout());
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = options.optLevel;
+    builder.SizeLevel = 0;
+    builder.LoopVectorize = options.optLevel > 1;
+    builder.SLPVectorize = options.optLevel > 1;
+    builder.Inliner = createInliner(options.optLevel);
+
+    // The PGO passes run first in the module pipeline, so branch weights and entry counts are
+    // on the IR before inlining, and later block placement sees them too
+    builder.EnablePGOInstrGen = options.profileGenerate;
+    builder.PGOInstrGen = options.profileGeneratePath;
+    builder.PGOInstrUse = options.profileUsePath;
+
+    // Leave cross-module work to the link step
+    builder.PrepareForLTO = options.lto == LtoMode::FULL;
+    builder.PrepareForThinLTO = options.lto == LtoMode::THIN;
+    targetMachine->adjustPassManager(builder);
+
+    llvm::legacy::FunctionPassManager functionPasses(&module);
+    llvm::legacy::PassManager modulePasses;
+    addTargetAnalysis(functionPasses, *targetMachine);
+    addTargetAnalysis(modulePasses, *targetMachine);
+    builder.populateFunctionPassManager(functionPasses);
+    builder.populateModulePassManager(modulePasses);
+
+    functionPasses.doInitialization();
+    for (auto& func : module)
+    {
+        auto name = func.getName();
+        TraceSpan funcSpan("function passes", string_view(name.data(), name.size()));
+        functionPasses.run(func);
+    }
+    functionPasses.doFinalization();
+    TraceSpan moduleSpan("module passes");
+    modulePasses.run(module);
+}
+
+void optimizeLinkedModule(llvm::Module& module, const CompilerOptions& options)
+{
+    logi << "Running link time optimization on " << module.getName().str();
+    TraceSpan span("link time optimization");
+    auto targetMachine = createTargetMachine(options.optLevel);
+    module.setDataLayout(targetMachine->createDataLayout());
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+
+    llvm::legacy::PassManager passes;
+    addTargetAnalysis(passes, *targetMachine);
+    // The whole program is here, so exported functions only need to stay visible if they are
+    // the entry point. Everything else becomes a candidate for inlining and removal
+    passes.add(llvm::createInternalizePass(
+        [](const llvm::GlobalValue& value) { return value.getName() == "main"; }));
+
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = options.optLevel;
+    builder.SizeLevel = 0;
+    builder.Inliner = createInliner(options.optLevel);
+    targetMachine->adjustPassManager(builder);
+    builder.populateLTOPassManager(passes);
+    passes.run(module);
+}
+
+void writeObjectFile(llvm::Module& module, const string& filename, int optLevel)
+{
+    TraceSpan span("emit object", filename);
+    auto outFile = openOutputFile(filename);
+    writeObject(module, *outFile, optLevel);
+    outFile->flush();
+}
+
+std::vector<char> emitObject(llvm::Module& module, int optLevel)
+{
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream out(buffer);
+    writeObject(module, out, optLevel);
+    return std::vector<char>(buffer.begin(), buffer.end());
+}
+
+void writeLlFile(llvm::Module& module, const string& filename)
+{
+    TraceSpan span("emit ll", filename);
+    auto outFile = openOutputFile(filename);
+    module.print(*outFile, nullptr);
+}
+
+void writeBcFile(llvm::Module& module, const string& filename, bool thinLto)
+{
+    TraceSpan span("emit bc", filename);
+    auto outFile = openOutputFile(filename);
+    if (thinLto)
+    {
+        llvm::legacy::PassManager pass;
+        pass.add(llvm::createWriteThinLTOBitcodePass(*outFile));
+        pass.run(module);
+    }
+    else
+    {
+        llvm::WriteBitcodeToFile(&module, *outFile);
+    }
+    outFile->flush();
+}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+class Module;
+class TargetMachine;
+}
+
+namespace sk
+{
+struct CompilerOptions;
+
+/**
+ * Shared LLVM plumbing for everything that turns an llvm::Module into an artifact
+ */
+void initLlvmTargets();
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(int optLevel);
+
+/**
+ * Sets the data layout and triple of the host target, the optimizer and the linker need them
+ */
+void setHostTarget(llvm::Module& module);
+
+/**
+ * Number of IR instructions in all function bodies of module
+ */
+size_t countInstructions(const llvm::Module& module);
+
+/**
+ * Runs the per-module optimization pipeline, including PGO instrumentation or annotation
+ */
+void optimizeModule(llvm::Module& module, const CompilerOptions& options);
+
+/**
+ * Internalizes everything except main and runs the link time optimization pipeline. Meant for a
+ * module that was linked together from all the modules of a program
+ */
+void optimizeLinkedModule(llvm::Module& module, const CompilerOptions& options);
+
+void writeObjectFile(llvm::Module& module, const std::string& filename, int optLevel);
+/**
+ * The object file writeObjectFile would write, in memory
+ */
+std::vector<char> emitObject(llvm::Module& module, int optLevel);
+void writeLlFile(llvm::Module& module, const std::string& filename);
+/**
+ * Writes bitcode. With thinLto the module summary used by ThinLTO linkers is written with it
+ */
+void writeBcFile(llvm::Module& module, const std::string& filename, bool thinLto);
+}
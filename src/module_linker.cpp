@@ -0,0 +1,138 @@
+#include "module_linker.hpp"
+#include "llvm_backend.hpp"
+#include "util/logger.hpp"
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using std::move;
+using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+
+namespace
+{
+/**
+ * The default handler exits on errors, these keep them for the exception linkModule throws
+ */
+void collectDiagnostic(const llvm::DiagnosticInfo& info, void* errors)
+{
+    string message;
+    llvm::raw_string_ostream os(message);
+    llvm::DiagnosticPrinterRawOStream printer(os);
+    info.print(printer);
+    if (info.getSeverity() == llvm::DS_Error)
+    {
+        *static_cast<string*>(errors) += os.str();
+    }
+    else if (info.getSeverity() == llvm::DS_Warning)
+    {
+        logw << os.str();
+    }
+}
+}
+
+namespace sk
+{
+ModuleLinker::ModuleLinker(const string& name, const CompilerOptions& options)
+    : m_name(name),
+      m_options(options),
+      m_llvmContext(new llvm::LLVMContext()),
+      m_linkedModule(new llvm::Module(name, *m_llvmContext))
+{
+    initLlvmTargets();
+    setHostTarget(*m_linkedModule);
+#if LLVM_VERSION_MAJOR >= 6
+    m_llvmContext->setDiagnosticHandlerCallBack(collectDiagnostic, &m_errors);
+#else
+    m_llvmContext->setDiagnosticHandler(collectDiagnostic, &m_errors);
+#endif
+}
+
+void ModuleLinker::addSourceFile(const char* filename, ostream* astOut)
+{
+    logi << "Linking source file " << filename;
+    Compiler compiler(filename, *m_llvmContext, m_options);
+    compiler.compile();
+    if (astOut)
+    {
+        compiler.printAst(*astOut);
+    }
+    linkModule(compiler.takeLlvmModule());
+}
+
+void ModuleLinker::addIrFile(const char* filename)
+{
+    logi << "Linking IR file " << filename;
+    llvm::SMDiagnostic err;
+    auto module = llvm::parseIRFile(filename, err, *m_llvmContext);
+    if (!module)
+    {
+        string message;
+        llvm::raw_string_ostream os(message);
+        err.print(filename, os);
+        throw runtime_error(os.str());
+    }
+    linkModule(move(module));
+}
+
+void ModuleLinker::link()
+{
+    if (m_options.lto == LtoMode::FULL)
+    {
+        optimizeLinkedModule(*m_linkedModule, m_options);
+    }
+}
+
+void ModuleLinker::buildObjectFile()
+{
+    writeObjectFile(*m_linkedModule, getOutputFilename("o"), m_options.optLevel);
+}
+
+void ModuleLinker::buildLlFile()
+{
+    writeLlFile(*m_linkedModule, getOutputFilename("ll"));
+}
+
+void ModuleLinker::buildBcFile()
+{
+    writeBcFile(*m_linkedModule, getOutputFilename("bc"), m_options.lto == LtoMode::THIN);
+}
+
+void ModuleLinker::linkModule(unique_ptr<llvm::Module>&& module)
+{
+    setHostTarget(*module);
+    m_errors.clear();
+    if (llvm::Linker::linkModules(*m_linkedModule, move(module)))
+    {
+        ostringstream ss;
+        ss << "Failed to link module into " << m_name;
+        if (!m_errors.empty())
+        {
+            ss << ": " << m_errors;
+        }
+        throw runtime_error(ss.str());
+    }
+}
+
+string ModuleLinker::getOutputFilename(const char* extension) const
+{
+    if (!m_options.outputPath.empty())
+    {
+        return m_options.outputPath;
+    }
+    return m_name + "." + extension;
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "compiler.hpp"
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace llvm
+{
+class LLVMContext;
+class Module;
+}
+
+namespace sk
+{
+/**
+ * ModuleLinker
+ *
+ * Compiles several source files into one shared LLVMContext and links the resulting modules, and
+ * any precompiled bitcode such as the sklib runtime, into a single llvm::Module in memory
+ */
+class ModuleLinker
+{
+public:
+    ModuleLinker(const std::string& name, const CompilerOptions& options);
+
+    void addSourceFile(const char* filename, std::ostream* astOut = nullptr);
+    /**
+     * Links a .bc or .ll file
+     */
+    void addIrFile(const char* filename);
+
+    /**
+     * Runs link time optimization when it was requested in the options
+     */
+    void link();
+
+    void buildObjectFile();
+    void buildLlFile();
+    void buildBcFile();
+
+    llvm::Module& getLlvmModule() { return *m_linkedModule; }
+
+private:
+    void linkModule(std::unique_ptr<llvm::Module>&& module);
+    std::string getOutputFilename(const char* extension) const;
+
+    const std::string m_name;
+    const CompilerOptions m_options;
+    // LLVM errors reported while linking, the context's diagnostic handler collects them
+    std::string m_errors;
+    // Declared before the module, which has to be destroyed first
+    const std::unique_ptr<llvm::LLVMContext> m_llvmContext;
+    std::unique_ptr<llvm::Module> m_linkedModule;
+};
+}
@@ -1,5 +1,6 @@
 #include "parser.hpp"
 #include "util/logger.hpp"
+#include "util/trace.hpp"
 #include <ostream>
 #include <stdexcept>
 #include <sstream>
@@ -19,15 +20,35 @@ using std::vector;
 
 namespace sk
 {
-Parser::Parser(Module& module, Lexer& lexer) : m_module(module), m_lexer(lexer)
+Parser::Parser(Module& module, TokenSource& tokens) : m_module(module), m_tokens(tokens)
 {
 }
 
 void Parser::parse()
+{
+    TraceSpan span("parse");
+    begin();
+    parseBlock(m_module.getMainBlock());
+}
+
+void Parser::begin()
 {
     m_currentToken = takeToken();
     m_nextToken = takeToken();
-    parseBlock(m_module.getMainBlock());
+}
+
+Expr* Parser::parseTopLevelExpr()
+{
+    auto expr = parseExpression();
+    if (!expr)
+    {
+        return nullptr;
+    }
+    auto& block = m_module.getMainBlock();
+    auto& topLevelExpr = *expr;
+    block.getExpressions().push_back(std::ref(topLevelExpr));
+    block.addChild(move(expr));
+    return &topLevelExpr;
 }
 
 void Parser::parseBlock(Block& block)
@@ -202,10 +223,18 @@ std::unique_ptr<Expr> Parser::parseStringLiteral()
 
 unique_ptr<Expr> Parser::parseFunctionDefinition()
 {
+    TraceSpan span("parse function");
     advance(); // FN token
     auto id = parseIdentifier();
+    span.setDetail(id->getName());
+    auto isExported =
+        m_currentToken.getKind() == TokenKind::OPERATOR && m_currentToken.getStr() == "*";
+    if (isExported)
+    {
+        advance(); // * token
+    }
     auto parameterPattern = parseTupleMatch();
-    auto func = std::make_unique<Function>(move(id), move(parameterPattern));
+    auto func = std::make_unique<Function>(move(id), move(parameterPattern), isExported);
     parseBlock(func->getBlock());
     return unique_ptr<Expr>(move(func));
 }
@@ -324,10 +353,10 @@ void Parser::advance()
 
 Token Parser::takeToken()
 {
-    Token tok = m_lexer.take();
+    Token tok = m_tokens.take();
     while (!tok.isSignificant())
     {
-        tok = m_lexer.take();
+        tok = m_tokens.take();
     }
     return tok;
 }
@@ -8,10 +8,17 @@ namespace sk
 class Parser
 {
 public:
-    Parser(Module& module, Lexer& lexer);
+    Parser(Module& module, TokenSource& tokens);
 
     void parse();
 
+    /**
+     * Incremental alternative to parse(). After begin(), every parseTopLevelExpr() adds the next
+     * expression to the module's main block and returns it, or returns nullptr at the end
+     */
+    void begin();
+    Expr* parseTopLevelExpr();
+
 private:
     std::unique_ptr<Expr> parseExpression();
     void parseBlock(Block& block);
@@ -37,7 +44,7 @@ private:
     Token takeToken();
 
     Module& m_module;
-    Lexer& m_lexer;
+    TokenSource& m_tokens;
     Token m_currentToken;
     Token m_nextToken;
 };
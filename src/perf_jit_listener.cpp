@@ -0,0 +1,197 @@
+#include "perf_jit_listener.hpp"
+#include "util/logger.hpp"
+#include <llvm/Object/SymbolSize.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+using std::string;
+
+namespace sk
+{
+namespace
+{
+// Layout of the jitdump format from tools/perf/Documentation/jitdump-specification.txt
+const uint32_t jitDumpMagic = 0x4A695444;
+const uint32_t jitDumpVersion = 1;
+const uint32_t jitCodeLoad = 0;
+
+struct JitDumpHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t totalSize;
+    uint32_t elfMach;
+    uint32_t pad;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct JitDumpCodeLoad
+{
+    uint32_t id;
+    uint32_t totalSize;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t codeAddress;
+    uint64_t codeSize;
+    uint64_t codeIndex;
+};
+
+uint32_t getElfMachine()
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__arm__)
+    return EM_ARM;
+#else
+    return EM_NONE;
+#endif
+}
+
+/**
+ * perf record samples with CLOCK_MONOTONIC when run with -k mono, records have to match it
+ */
+uint64_t getTimestamp()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+}
+
+PerfJitListener::PerfJitListener(const string& dumpDir)
+{
+    openPerfMap();
+    openJitDump(dumpDir);
+}
+
+PerfJitListener::~PerfJitListener()
+{
+    if (m_jitDumpMarker)
+    {
+        munmap(m_jitDumpMarker, m_markerSize);
+    }
+    if (m_jitDump)
+    {
+        fclose(m_jitDump);
+    }
+    if (m_perfMap)
+    {
+        fclose(m_perfMap);
+    }
+}
+
+void PerfJitListener::openPerfMap()
+{
+    auto filename = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    m_perfMap = fopen(filename.c_str(), "w");
+    if (!m_perfMap)
+    {
+        logw << "Cannot write " << filename << ": " << strerror(errno);
+    }
+}
+
+void PerfJitListener::openJitDump(const string& dumpDir)
+{
+    auto filename = dumpDir + "/jit-" + std::to_string(getpid()) + ".dump";
+    auto fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0)
+    {
+        logw << "Cannot write " << filename << ": " << strerror(errno);
+        return;
+    }
+    m_markerSize = sysconf(_SC_PAGESIZE);
+    m_jitDumpMarker = mmap(nullptr, m_markerSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (m_jitDumpMarker == MAP_FAILED)
+    {
+        logw << "Cannot map " << filename << ": " << strerror(errno);
+        m_jitDumpMarker = nullptr;
+        close(fd);
+        return;
+    }
+    m_jitDump = fdopen(fd, "w");
+
+    JitDumpHeader header{};
+    header.magic = jitDumpMagic;
+    header.version = jitDumpVersion;
+    header.totalSize = sizeof(header);
+    header.elfMach = getElfMachine();
+    header.pid = getpid();
+    header.timestamp = getTimestamp();
+    fwrite(&header, sizeof(header), 1, m_jitDump);
+    fflush(m_jitDump);
+}
+
+void PerfJitListener::NotifyObjectEmitted(const llvm::object::ObjectFile& object,
+                                          const llvm::RuntimeDyld::LoadedObjectInfo& info)
+{
+    // The debug object has the symbols relocated to where the code was loaded
+    auto debugObject = info.getObjectForDebug(object);
+    if (!debugObject.getBinary())
+    {
+        return;
+    }
+    for (auto& symbolSize : llvm::object::computeSymbolSizes(*debugObject.getBinary()))
+    {
+        auto symbol = symbolSize.first;
+        auto type = symbol.getType();
+        if (!type || *type != llvm::object::SymbolRef::ST_Function)
+        {
+            llvm::consumeError(type.takeError());
+            continue;
+        }
+        auto name = symbol.getName();
+        auto address = symbol.getAddress();
+        if (!name || !address)
+        {
+            llvm::consumeError(name.takeError());
+            llvm::consumeError(address.takeError());
+            continue;
+        }
+        // Skiff functions keep their source names, only the top level code is renamed
+        writeFunction(*name == "main" ? "main (top level)" : name->str(), *address,
+                      symbolSize.second);
+    }
+}
+
+void PerfJitListener::writeFunction(const string& name, uint64_t address, uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_perfMap)
+    {
+        fprintf(m_perfMap, "%lx %lx %s\n", static_cast<unsigned long>(address),
+                static_cast<unsigned long>(size), name.c_str());
+        fflush(m_perfMap);
+    }
+    if (m_jitDump)
+    {
+        JitDumpCodeLoad record{};
+        record.id = jitCodeLoad;
+        record.totalSize = sizeof(record) + name.size() + 1 + size;
+        record.timestamp = getTimestamp();
+        record.pid = getpid();
+        record.tid = syscall(SYS_gettid);
+        record.vma = address;
+        record.codeAddress = address;
+        record.codeSize = size;
+        record.codeIndex = m_codeIndex++;
+        fwrite(&record, sizeof(record), 1, m_jitDump);
+        fwrite(name.c_str(), name.size() + 1, 1, m_jitDump);
+        fwrite(reinterpret_cast<const void*>(address), size, 1, m_jitDump);
+        fflush(m_jitDump);
+    }
+}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+namespace sk
+{
+/**
+ * PerfJitListener
+ *
+ * Tells Linux perf about JIT compiled functions so samples in them resolve to Skiff function
+ * names. Every function is written to /tmp/perf-<pid>.map, which perf report reads on its own,
+ * and to a jitdump file, jit-<pid>.dump in dumpDir, which perf inject --jit turns into ELF
+ * images so perf annotate can show the machine code too. LLVM 6 and later have
+ * JITEventListener::createPerfJITEventListener, but only in LLVM builds with LLVM_USE_PERF, and it
+ * writes no perf map
+ */
+class PerfJitListener : public llvm::JITEventListener
+{
+public:
+    explicit PerfJitListener(const std::string& dumpDir = "/tmp");
+    ~PerfJitListener() override;
+
+    void NotifyObjectEmitted(const llvm::object::ObjectFile& object,
+                             const llvm::RuntimeDyld::LoadedObjectInfo& info) override;
+
+private:
+    void openPerfMap();
+    void openJitDump(const std::string& dumpDir);
+    void writeFunction(const std::string& name, uint64_t address, uint64_t size);
+
+    std::mutex m_mutex;
+    FILE* m_perfMap = nullptr;
+    FILE* m_jitDump = nullptr;
+    // perf record finds the jitdump file through this executable mapping of it
+    void* m_jitDumpMarker = nullptr;
+    size_t m_markerSize = 0;
+    uint64_t m_codeIndex = 0;
+};
+}
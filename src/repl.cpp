@@ -0,0 +1,108 @@
+#include "repl.hpp"
+#include "ast_printer.hpp"
+#include "code_gen.hpp"
+#include "llvm_backend.hpp"
+#include "util/logger.hpp"
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_os_ostream.h>
+
+using std::string;
+using std::unique_ptr;
+
+namespace sk
+{
+Repl::Repl(std::ostream& out, std::ostream& codeOut, const CompilerOptions& options, bool perf)
+    : m_out(out), m_codeOut(codeOut), m_options(options), m_lexer(m_sourceBuffer),
+      m_module("ski"), m_parser(m_module, m_lexer), m_jit(perf)
+{
+}
+
+void Repl::addLine(const string& line)
+{
+    logi << "parsing input: " << line;
+
+    auto& expressions = m_module.getMainBlock().getExpressions();
+    auto firstNew = expressions.size();
+    m_sourceBuffer.addBlock(line + '\n');
+    m_parser.parse();
+
+    // Functions first, so the line can call a function it defines further along
+    auto previousFunctions = m_functions;
+    auto hasFunctions = false;
+    for (auto i = firstNew; i < expressions.size(); ++i)
+    {
+        AstPrinter printer(m_codeOut);
+        printer.dispatch(expressions[i]);
+        if (auto func = dynamic_cast<Function*>(&expressions[i].get()))
+        {
+            m_functions.erase(func->getName());
+            m_functions.emplace(func->getName(), *func);
+            hasFunctions = true;
+        }
+    }
+    // A function calling something undefined would make every later line fail, so the line
+    // is rejected and the definitions it replaced come back
+    if (hasFunctions)
+    {
+        try
+        {
+            m_jit.checkSymbols(*generate(nullptr));
+        }
+        catch (...)
+        {
+            m_functions = std::move(previousFunctions);
+            throw;
+        }
+    }
+    for (auto i = firstNew; i < expressions.size(); ++i)
+    {
+        if (!dynamic_cast<Function*>(&expressions[i].get()))
+        {
+            run(expressions[i]);
+        }
+    }
+}
+
+void Repl::run(Expr& expr)
+{
+    auto llvmModule = generate(&expr);
+    optimizeModule(*llvmModule, m_options);
+    {
+        llvm::raw_os_ostream irOut(m_codeOut);
+        llvmModule->print(irOut, nullptr);
+    }
+
+    auto value = m_jit.runMain(std::move(llvmModule));
+    if (auto letExpr = dynamic_cast<LetExpr*>(&expr))
+    {
+        auto name = letExpr->getIdentifier().getName();
+        m_lets[name] = value;
+        m_out << name << " = " << value << std::endl;
+    }
+    else
+    {
+        m_out << value << std::endl;
+    }
+}
+
+unique_ptr<llvm::Module> Repl::generate(Expr* expr)
+{
+    CodeGen codeGen("ski", m_llvmContext);
+    codeGen.beginModule();
+    for (auto& let : m_lets)
+    {
+        codeGen.defineConstant(let.first, let.second);
+    }
+    for (auto& function : m_functions)
+    {
+        codeGen.addTopLevelExpr(function.second);
+    }
+    // main returns the value of its last expression, for a let that is the bound value
+    if (expr)
+    {
+        codeGen.addTopLevelExpr(*expr);
+    }
+    codeGen.finishModule(m_module);
+    return codeGen.takeLlvmModule();
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "ast.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "util/string_view.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace llvm
+{
+class Module;
+}
+
+namespace sk
+{
+/**
+ * Repl
+ *
+ * The read eval print loop of ski. Lines are parsed into one Module, but only the top level
+ * expressions a line adds are run, each with a main of its own that returns its value. Functions
+ * are generated again into every one of those modules, and the values of top level lets are
+ * carried to later lines as constants
+ */
+class Repl
+{
+public:
+    /**
+     * out: receives the value of everything that runs
+     * codeOut: receives the AST and the IR of everything that runs
+     * perf: tell Linux perf about the compiled code, see Jit
+     */
+    Repl(std::ostream& out, std::ostream& codeOut,
+         const CompilerOptions& options = CompilerOptions(), bool perf = false);
+
+    /**
+     * Throws when the line doesn't parse, or calls a function that isn't defined. Lines after
+     * that still work
+     */
+    void addLine(const std::string& line);
+
+private:
+    void run(Expr& expr);
+    /**
+     * Every function entered so far, and a main that runs expr when it isn't null
+     */
+    std::unique_ptr<llvm::Module> generate(Expr* expr);
+
+    std::ostream& m_out;
+    std::ostream& m_codeOut;
+    const CompilerOptions m_options;
+    SourceBuffer m_sourceBuffer;
+    Lexer m_lexer;
+    Module m_module;
+    Parser m_parser;
+    // The latest definition of every function entered so far
+    std::map<string_view, std::reference_wrapper<Function>> m_functions;
+    std::map<string_view, int32_t> m_lets;
+    // The Jit's engines own modules made in this context, so the context has to outlive it
+    llvm::LLVMContext m_llvmContext;
+    Jit m_jit;
+};
+}
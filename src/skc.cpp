@@ -1,42 +1,54 @@
 /**
  * Skiff Compiler
  */
-#include "compiler.hpp"
-#include "util/logger.hpp"
+#include "compile_server.hpp"
+#include "driver.hpp"
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
-using sk::Compiler;
-using std::cin;
 using std::cout;
-using std::endl;
+using std::strcmp;
+using std::strncmp;
+using std::string;
+using std::vector;
 
 int main(int argc, char** argv)
 {
-    if (argc < 2) {
-        cout << "USAGE: skc [-s] file.sk" << endl;
-        return 1;
-    }
-
     //sk::setLogSeverity(sk::LogSeverity::WARN);
 
-    logd << "Building compiler";
-    auto* inFilename = argv[argc - 1];
-    Compiler compiler(inFilename);
-
-    logd << "compiling...";
-    compiler.compile();
-
-    logd << "done compiling";
-    compiler.printAst(cout);
-    cout << endl;
-
-    if (argc > 2)
-    {
-        compiler.buildObjectFile();
-    }
-    else
+    vector<string> args(argv + 1, argv + argc);
+    if (!args.empty() && strncmp(args[0].c_str(), "--connect", 9) == 0)
     {
-        compiler.buildLlFile();
+        // Forward the rest of the command line to a running skcd
+        const char* connect = args[0].c_str();
+        string socketPath;
+        if (strcmp(connect, "--connect") == 0)
+        {
+            socketPath = sk::getDefaultCompileServerSocket();
+        }
+        else if (connect[9] == '=')
+        {
+            socketPath = connect + 10;
+        }
+        else
+        {
+            return sk::runCompilerDriver({}, cout);
+        }
+        try
+        {
+            return sk::runOnCompileServer(socketPath,
+                                          vector<string>(args.begin() + 1, args.end()), cout);
+        }
+        catch (const std::runtime_error& e)
+        {
+            // Usually skcd isn't running or the socket path is wrong
+            std::cerr << "skc: " << e.what() << std::endl;
+            return 1;
+        }
     }
+
+    return sk::runCompilerDriver(args, cout);
 }
@@ -0,0 +1,34 @@
+/**
+ * Skiff compile server, run skc --connect to send it compiles
+ */
+#include "compile_server.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using sk::CompileServer;
+using std::cout;
+using std::endl;
+using std::string;
+
+int main(int argc, char** argv)
+{
+    if (argc > 2)
+    {
+        cout << "USAGE: skcd [socket]" << endl;
+        return 1;
+    }
+
+    auto socketPath = argc == 2 ? string(argv[1]) : sk::getDefaultCompileServerSocket();
+    try
+    {
+        CompileServer server(socketPath);
+        server.run();
+    }
+    catch (const std::runtime_error& e)
+    {
+        // Usually the socket path can't be bound
+        std::cerr << "skcd: " << e.what() << std::endl;
+        return 1;
+    }
+}
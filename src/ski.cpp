@@ -1,55 +1,104 @@
 /**
  * Skiff Interpreter
  */
-#include "ast.hpp"
-#include "code_gen.hpp"
-#include "lexer.hpp"
-#include "ast_printer.hpp"
-#include "source.hpp"
-#include "parser.hpp"
-#include "util/logger.hpp"
-#include <llvm/Support/raw_ostream.h>
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "repl.hpp"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
-#include <memory>
 
-using sk::AstPrinter;
-using sk::CodeGen;
-using sk::Module;
-using sk::Lexer;
-using sk::Token;
-using sk::Parser;
-using sk::SourceBuffer;
+using sk::Compiler;
+using sk::CompilerOptions;
+using sk::Jit;
+using sk::Repl;
 using std::getline;
 using std::cin;
 using std::cout;
 using std::endl;
 using std::flush;
-using std::make_unique;
+using std::strcmp;
+using std::strlen;
+using std::strncmp;
 using std::string;
 
-int main(int argc, char** argv)
+namespace
 {
-    cout << "ski> " << flush;
-
-    auto sourceBuffer = make_unique<SourceBuffer>();
-    Lexer lexer(*sourceBuffer);
-    Module module("ski");
-    Parser parser(module, lexer);
+void printUsage()
+{
+    cout << "USAGE: ski [-O<0-3>] [--perf] [file.sk]" << endl;
+}
 
+/**
+ * Reads lines from stdin and runs the top level code each one adds, see Repl
+ */
+void runRepl(const CompilerOptions& options, bool perf)
+{
+    Repl repl(cout, cout, options, perf);
+    cout << "ski> " << flush;
     for (string line; getline(cin, line);)
     {
-        logi << "parsing input: " << line;
+        try
+        {
+            repl.addLine(line);
+        }
+        catch (const std::exception& e)
+        {
+            cout << "error: " << e.what() << endl;
+        }
+        cout << "ski> " << flush;
+    }
+}
+}
 
-        sourceBuffer->addBlock(line);
-        parser.parse();
+int main(int argc, char** argv)
+{
+    CompilerOptions options;
+    auto perf = false;
+    const char* inFilename = nullptr;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-' && !inFilename)
+        {
+            inFilename = arg;
+        }
+        else if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '3')
+        {
+            options.optLevel = arg[2] - '0';
+        }
+        else if (strcmp(arg, "--perf") == 0)
+        {
+            perf = true;
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
 
-        AstPrinter printer(cout);
-        printer.dispatch(module);
+    if (!inFilename)
+    {
+        runRepl(options, perf);
+        return 0;
+    }
 
-        CodeGen codeGen("ski");
-        codeGen.dispatch(module);
-        codeGen.getLlvmModule().print(llvm::outs(), nullptr);
-        cout << "ski> " << flush;
+    // Runs the file's top level code and exits with its value, like the skc build would
+    try
+    {
+        llvm::LLVMContext llvmContext;
+        Compiler compiler(inFilename, llvmContext, options);
+        compiler.compile();
+        Jit jit(perf);
+        return jit.runMain(compiler.takeLlvmModule());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << inFilename << ": error: " << e.what() << endl;
+        return 1;
     }
 }
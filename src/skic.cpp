@@ -3,26 +3,152 @@
  */
 #include "wasm_compiler.hpp"
 #include "util/logger.hpp"
+#include "util/time_report.hpp"
+#include <cstring>
 #include <iostream>
 #include <string>
 
+using sk::TimeReport;
 using sk::WasmCompiler;
+using sk::WasmCompilerOptions;
 using std::cin;
 using std::cout;
 using std::endl;
+using std::strcmp;
+using std::strlen;
+using std::strncmp;
+
+namespace
+{
+enum class EmitKind
+{
+    WAT,
+    WASM
+};
+
+void printUsage()
+{
+    cout << "USAGE: skic [-O<0-4>|-Os|-Oz] [--emit=wat|wasm] [-o output.wasm] [--source-map] "
+            "[--size-report] [--run] [--simd] [--threads] [--profile-generate=order.txt] "
+            "[--profile-use=order.txt [--split-cold]] [--time-report[=json]] file.sk"
+         << endl;
+}
+}
 
 int main(int argc, char** argv)
 {
     if (argc < 2) {
-        cout << "USAGE: skic [-s] file.sk" << endl;
+        printUsage();
         return 1;
     }
 
     //sk::setLogSeverity(sk::LogSeverity::WARN);
 
+    WasmCompilerOptions options;
+    auto emit = EmitKind::WAT;
+    auto sizeReport = false;
+    auto run = false;
+    auto timeReport = false;
+    auto timeReportJson = false;
+    const char* inFilename = nullptr;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            inFilename = arg;
+        }
+        else if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '4')
+        {
+            options.optLevel = arg[2] - '0';
+            options.shrinkLevel = 0;
+        }
+        else if (strcmp(arg, "-Os") == 0)
+        {
+            options.optLevel = 2;
+            options.shrinkLevel = 1;
+        }
+        else if (strcmp(arg, "-Oz") == 0)
+        {
+            options.optLevel = 2;
+            options.shrinkLevel = 2;
+        }
+        else if (strcmp(arg, "--emit=wat") == 0)
+        {
+            emit = EmitKind::WAT;
+        }
+        else if (strcmp(arg, "--emit=wasm") == 0)
+        {
+            emit = EmitKind::WASM;
+        }
+        else if (strcmp(arg, "-o") == 0 && i + 1 < argc)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (strcmp(arg, "--source-map") == 0)
+        {
+            options.sourceMap = true;
+        }
+        else if (strcmp(arg, "--size-report") == 0)
+        {
+            sizeReport = true;
+        }
+        else if (strcmp(arg, "--simd") == 0)
+        {
+            options.simd = true;
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options.threads = true;
+        }
+        else if (strncmp(arg, "--profile-generate=", 19) == 0)
+        {
+            options.profileGeneratePath = arg + 19;
+        }
+        else if (strncmp(arg, "--profile-use=", 14) == 0)
+        {
+            options.profileUsePath = arg + 14;
+        }
+        else if (strcmp(arg, "--split-cold") == 0)
+        {
+            options.splitCold = true;
+        }
+        else if (strcmp(arg, "--run") == 0)
+        {
+            run = true;
+        }
+        else if (strcmp(arg, "--time-report") == 0)
+        {
+            timeReport = true;
+        }
+        else if (strcmp(arg, "--time-report=json") == 0)
+        {
+            timeReport = true;
+            timeReportJson = true;
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    // The interpreter can't load the cold module, and profiles come from running
+    if (!inFilename || ((options.sourceMap || sizeReport) && emit != EmitKind::WASM) ||
+        (options.splitCold && (options.profileUsePath.empty() || run)) ||
+        (!options.profileGeneratePath.empty() && !run))
+    {
+        printUsage();
+        return 1;
+    }
+
+    TimeReport report(inFilename);
+    if (timeReport)
+    {
+        options.timeReport = &report;
+    }
+
     logd << "Building compiler";
-    auto* inFilename = argv[argc - 1];
-    WasmCompiler compiler(inFilename);
+    WasmCompiler compiler(inFilename, options);
 
     logd << "compiling...";
     compiler.compile();
@@ -31,6 +157,28 @@ int main(int argc, char** argv)
     compiler.printAst(cout);
     cout << endl;
 
-    logd << "**** BINARYEN IR MODULE ****";
-    compiler.printIr();
+    if (emit == EmitKind::WASM)
+    {
+        compiler.buildWasmFile(sizeReport ? &cout : nullptr);
+    }
+    else if (!run)
+    {
+        logd << "**** BINARYEN IR MODULE ****";
+        compiler.printIr();
+    }
+
+    // Running isn't part of compiling, so the report ends before it
+    if (timeReportJson)
+    {
+        report.printJson(cout);
+    }
+    else if (timeReport)
+    {
+        report.printTable(cout);
+    }
+
+    if (run)
+    {
+        compiler.run(cout);
+    }
 }
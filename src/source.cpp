@@ -26,7 +26,7 @@ std::unique_ptr<SourceBuffer> SourceBuffer::fromSourceStr(string_view src)
 SourceBuffer SourceBuffer::readFile(const char* filename, const size_t blockSize)
 {
     SourceBuffer buffer;
-    auto f = fopen(filename, "r");
+    std::unique_ptr<FILE, decltype(&fclose)> f(fopen(filename, "r"), &fclose);
     if (!f)
     {
         ostringstream ss;
@@ -36,7 +36,7 @@ SourceBuffer SourceBuffer::readFile(const char* filename, const size_t blockSize
     for (auto bytesRead = blockSize; bytesRead == blockSize;)
     {
         vector<char> block(blockSize);
-        bytesRead = fread(block.data(), 1, block.size(), f);
+        bytesRead = fread(block.data(), 1, block.size(), f.get());
         block.resize(bytesRead);
         buffer.addBlock(move(block));
     }
@@ -72,6 +72,11 @@ void SourceBuffer::addBlock(string_view s)
     addBlock(move(block));
 }
 
+bool SourceBuffer::operator==(const SourceBuffer& other) const
+{
+    return m_totalSize == other.m_totalSize && std::equal(cbegin(), cend(), other.cbegin());
+}
+
 char SourceBuffer::getChar(size_t byteOffset) const
 {
     auto blockOffset = byteToBlockOffset(byteOffset);
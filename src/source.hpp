@@ -36,6 +36,12 @@ public:
 
     std::vector<std::vector<char>>& getBlocks() { return m_blocks; }
 
+    /**
+     * Same contents, however they are split into blocks
+     */
+    bool operator==(const SourceBuffer& other) const;
+    bool operator!=(const SourceBuffer& other) const { return !(*this == other); }
+
     char getChar(size_t byteOffset) const;
     string_view getString(size_t byteOffset, size_t size);
 
@@ -0,0 +1,33 @@
+#pragma once
+#include "string_view.hpp"
+#include <cstdio>
+#include <ostream>
+
+namespace sk
+{
+/**
+ * Writes s as a quoted JSON string
+ */
+inline void printJsonString(std::ostream& os, string_view s)
+{
+    os << '"';
+    for (auto c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            os << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            os << escape;
+        }
+        else
+        {
+            os << c;
+        }
+    }
+    os << '"';
+}
+}
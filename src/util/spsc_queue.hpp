@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sk
+{
+/**
+ * SpscQueue
+ *
+ * Bounded lock-free ring buffer for exactly one producer and one consumer thread. push() waits
+ * while the queue is full, which is what gives a pipeline back-pressure, and pop() waits while it
+ * is empty. A waiting thread spins briefly, then sleeps until the other side moves, so a stage
+ * that is far ahead of the next one doesn't burn a core. The consumer can close() the queue to
+ * make pushes fail, so a producer never waits forever on a consumer that gave up.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) : m_slots(roundUpToPowerOfTwo(capacity)) {}
+    void operator=(const SpscQueue&) = delete;
+    SpscQueue(const SpscQueue&) = delete;
+
+    /**
+     * Returns false without pushing once the queue is closed
+     */
+    bool push(T value)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        wait([this, tail] {
+            return tail - m_head.load(std::memory_order_acquire) != m_slots.size() ||
+                   m_closed.load(std::memory_order_relaxed);
+        });
+        if (m_closed.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        m_slots[tail & (m_slots.size() - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        wakeWaiter();
+        return true;
+    }
+
+    T pop()
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        wait([this, head] { return head != m_tail.load(std::memory_order_acquire); });
+        T value = std::move(m_slots[head & (m_slots.size() - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        wakeWaiter();
+        return value;
+    }
+
+    void close()
+    {
+        m_closed.store(true, std::memory_order_relaxed);
+        wakeWaiter();
+    }
+
+    size_t capacity() const { return m_slots.size(); }
+
+private:
+    static size_t roundUpToPowerOfTwo(size_t n)
+    {
+        size_t size = 1;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    /**
+     * Returns once ready() holds. Stages run at similar rates, so a short spin usually finds the
+     * next slot, a thread that is still waiting after that sleeps until wakeWaiter()
+     */
+    template <typename Ready>
+    void wait(Ready ready)
+    {
+        for (auto spins = 0u; spins < 256; ++spins)
+        {
+            if (ready())
+            {
+                return;
+            }
+            if (spins > 64)
+            {
+                std::this_thread::yield();
+            }
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_waiters.fetch_add(1, std::memory_order_relaxed);
+        // Pairs with the fence in wakeWaiter, either the waker sees the waiter or the waiter
+        // sees the change
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_changed.wait(lock, ready);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wakeWaiter()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) > 0)
+        {
+            // Taking the lock means a waiter is either asleep or hasn't checked ready() yet
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_changed.notify_all();
+        }
+    }
+
+    std::vector<T> m_slots;
+    // On separate cache lines so the producer and consumer don't invalidate each other's line
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    std::atomic<bool> m_closed{false};
+
+    // Only touched once a thread gives up spinning
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::atomic<unsigned> m_waiters{0};
+};
+}
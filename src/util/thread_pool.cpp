@@ -0,0 +1,123 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace
+{
+thread_local const sk::ThreadPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+}
+
+namespace sk
+{
+ThreadPool::ThreadPool(size_t numThreads) : m_nextQueue(0)
+{
+    // hardware_concurrency() is 0 when it is unknown
+    numThreads = std::max<size_t>(numThreads, 1);
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        m_queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::runWorker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    auto index = currentPool == this ? currentWorker : m_nextQueue++ % m_queues.size();
+    {
+        // Counted under the same lock so a worker can't take the task before it is counted
+        lock_guard<mutex> lock(m_mutex);
+        lock_guard<mutex> queueLock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+        ++m_numQueued;
+        ++m_numUnfinished;
+    }
+    m_workAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_allDone.wait(lock, [this] { return m_numUnfinished == 0; });
+}
+
+void ThreadPool::runWorker(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+    Task task;
+    while (true)
+    {
+        if (takeTask(index, task))
+        {
+            {
+                lock_guard<mutex> lock(m_mutex);
+                --m_numQueued;
+            }
+            task();
+            task = nullptr;
+
+            lock_guard<mutex> lock(m_mutex);
+            if (--m_numUnfinished == 0)
+            {
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_mutex);
+        m_workAvailable.wait(lock, [this] { return m_stopping || m_numQueued > 0; });
+        if (m_stopping && m_numQueued == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::takeTask(size_t index, Task& task)
+{
+    {
+        auto& own = *m_queues[index];
+        lock_guard<mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < m_queues.size(); ++offset)
+    {
+        auto& victim = *m_queues[(index + offset) % m_queues.size()];
+        lock_guard<mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+}
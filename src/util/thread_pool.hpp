@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sk
+{
+/**
+ * ThreadPool
+ *
+ * Work-stealing pool. Every worker has its own deque, runs its newest task first and steals the
+ * oldest task of another worker when its own deque is empty. Tasks submitted from a worker go to
+ * that worker's deque, others are spread round-robin. Tasks must not throw.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    void operator=(const ThreadPool&) = delete;
+    ThreadPool(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    /**
+     * Blocks until every submitted task, including the ones they submitted, has finished. Not
+     * callable from a task
+     */
+    void wait();
+
+    size_t size() const { return m_workers.size(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void runWorker(size_t index);
+    bool takeTask(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_nextQueue;
+
+    // Guards the counts and stop flag for sleeping workers and wait()
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    size_t m_numQueued = 0;
+    size_t m_numUnfinished = 0;
+    bool m_stopping = false;
+};
+}
@@ -0,0 +1,110 @@
+#include "time_report.hpp"
+#include "json.hpp"
+#include <iomanip>
+#include <sys/resource.h>
+
+using std::ostream;
+using std::setw;
+using std::string;
+
+namespace
+{
+sk::AllocatedBytesCounter allocatedBytesCounter = nullptr;
+
+size_t getPeakRssKiB()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // Linux reports kilobytes
+    return usage.ru_maxrss;
+}
+}
+
+namespace sk
+{
+void setAllocatedBytesCounter(AllocatedBytesCounter counter)
+{
+    allocatedBytesCounter = counter;
+}
+
+size_t getThreadAllocatedBytes()
+{
+    return allocatedBytesCounter ? allocatedBytesCounter() : 0;
+}
+
+void TimeReport::printTable(ostream& os) const
+{
+    os << "Time report for " << m_title << "\n";
+    os << std::left << setw(10) << "phase" << std::right << setw(12) << "seconds" << setw(14)
+       << "alloc KiB" << setw(14) << "peak RSS KiB" << "  count\n";
+    double totalSeconds = 0;
+    size_t totalAllocated = 0;
+    for (auto& phase : m_phases)
+    {
+        os << std::left << setw(10) << phase.name << std::right << std::fixed
+           << std::setprecision(6) << setw(12) << phase.seconds << setw(14)
+           << phase.bytesAllocated / 1024 << setw(14) << phase.peakRssKiB;
+        if (!phase.countUnit.empty())
+        {
+            os << "  " << phase.count << " " << phase.countUnit;
+        }
+        os << "\n";
+        totalSeconds += phase.seconds;
+        totalAllocated += phase.bytesAllocated;
+    }
+    os << std::left << setw(10) << "total" << std::right << setw(12) << totalSeconds << setw(14)
+       << totalAllocated / 1024 << setw(14)
+       << (m_phases.empty() ? 0 : m_phases.back().peakRssKiB) << std::endl;
+    os.unsetf(std::ios::floatfield);
+}
+
+void TimeReport::printJson(ostream& os) const
+{
+    os << "{\"file\":";
+    printJsonString(os, m_title);
+    os << ",\"phases\":[";
+    for (auto i = 0u; i < m_phases.size(); ++i)
+    {
+        auto& phase = m_phases[i];
+        os << (i ? "," : "") << "{\"name\":";
+        printJsonString(os, phase.name);
+        os << ",\"seconds\":" << phase.seconds << ",\"bytesAllocated\":" << phase.bytesAllocated
+           << ",\"peakRssKiB\":" << phase.peakRssKiB;
+        if (!phase.countUnit.empty())
+        {
+            os << ",\"count\":" << phase.count << ",\"unit\":";
+            printJsonString(os, phase.countUnit);
+        }
+        os << "}";
+    }
+    os << "]}" << std::endl;
+}
+
+TimePhase::TimePhase(TimeReport* report, const char* name) : m_report(report)
+{
+    if (m_report)
+    {
+        m_timing.name = name;
+        m_startAllocated = getThreadAllocatedBytes();
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+TimePhase::~TimePhase()
+{
+    if (m_report)
+    {
+        m_timing.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        m_timing.bytesAllocated = getThreadAllocatedBytes() - m_startAllocated;
+        m_timing.peakRssKiB = getPeakRssKiB();
+        m_report->addPhase(std::move(m_timing));
+    }
+}
+
+void TimePhase::setCount(size_t count, const char* unit)
+{
+    m_timing.count = count;
+    m_timing.countUnit = unit;
+}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sk
+{
+struct PhaseTiming
+{
+    std::string name;
+    double seconds = 0;
+    // Allocated with operator new on the phase's thread, frees are not subtracted. 0 unless the
+    // executable counts its allocations, see setAllocatedBytesCounter
+    size_t bytesAllocated = 0;
+    // Process high-water mark at the end of the phase
+    size_t peakRssKiB = 0;
+    // What the phase produced, e.g. tokens or IR instructions
+    size_t count = 0;
+    std::string countUnit;
+};
+
+/**
+ * TimeReport
+ *
+ * Per phase timing and memory of one compile, for skc and skic --time-report
+ */
+class TimeReport
+{
+public:
+    TimeReport(std::string title) : m_title(std::move(title)) {}
+
+    void addPhase(PhaseTiming phase) { m_phases.push_back(std::move(phase)); }
+    const std::vector<PhaseTiming>& getPhases() const { return m_phases; }
+
+    void printTable(std::ostream& os) const;
+    /**
+     * One JSON object on a single line
+     */
+    void printJson(std::ostream& os) const;
+
+private:
+    const std::string m_title;
+    std::vector<PhaseTiming> m_phases;
+};
+
+/**
+ * Records the enclosing scope as a phase of report, and does nothing when report is null
+ */
+class TimePhase
+{
+public:
+    TimePhase(TimeReport* report, const char* name);
+    ~TimePhase();
+    void operator=(const TimePhase&) = delete;
+    TimePhase(const TimePhase&) = delete;
+
+    void setCount(size_t count, const char* unit);
+
+private:
+    TimeReport* const m_report;
+    PhaseTiming m_timing;
+    std::chrono::steady_clock::time_point m_start;
+    size_t m_startAllocated = 0;
+};
+
+/**
+ * Counting allocations means replacing the global operator new, which only executables should
+ * do. Those that do, like skc, register how to read the calling thread's count here
+ */
+using AllocatedBytesCounter = size_t (*)();
+void setAllocatedBytesCounter(AllocatedBytesCounter counter);
+
+/**
+ * Bytes this thread has allocated with operator new since it started, 0 without a counter
+ */
+size_t getThreadAllocatedBytes();
+}
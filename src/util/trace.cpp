@@ -0,0 +1,133 @@
+#include "trace.hpp"
+#include "json.hpp"
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using std::lock_guard;
+using std::mutex;
+using std::ostream;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace
+{
+struct TraceEvent
+{
+    const char* name;
+    string detail;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+struct ThreadBuffer
+{
+    size_t tid;
+    vector<TraceEvent> events;
+};
+
+// Buffers outlive their threads so the spans of pool workers are still there to write
+mutex buffersMutex;
+vector<unique_ptr<ThreadBuffer>> buffers;
+// Bumped by startTracing(), which frees the buffers, so threads know to register again
+std::atomic<unsigned> generation{0};
+uint64_t traceStartNs = 0;
+
+uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+thread_local ThreadBuffer* threadBuffer = nullptr;
+thread_local unsigned threadGeneration = 0;
+
+ThreadBuffer& getThreadBuffer()
+{
+    auto currentGeneration = generation.load(std::memory_order_acquire);
+    if (!threadBuffer || threadGeneration != currentGeneration)
+    {
+        // Once per thread and trace, every later event goes straight to the buffer
+        lock_guard<mutex> lock(buffersMutex);
+        buffers.emplace_back(new ThreadBuffer{buffers.size() + 1, {}});
+        threadBuffer = buffers.back().get();
+        threadGeneration = currentGeneration;
+    }
+    return *threadBuffer;
+}
+
+void printMicroseconds(ostream& os, uint64_t ns)
+{
+    os << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+       << std::setfill(' ');
+}
+}
+
+namespace sk
+{
+namespace detail
+{
+std::atomic<bool> tracingEnabled{false};
+}
+
+void startTracing()
+{
+    {
+        lock_guard<mutex> lock(buffersMutex);
+        buffers.clear();
+        ++generation;
+        traceStartNs = nowNs();
+    }
+    detail::tracingEnabled.store(true, std::memory_order_release);
+}
+
+void stopTracing()
+{
+    detail::tracingEnabled.store(false, std::memory_order_release);
+}
+
+void writeTrace(ostream& os)
+{
+    lock_guard<mutex> lock(buffersMutex);
+    os << "{\"traceEvents\":[";
+    auto first = true;
+    for (auto& buffer : buffers)
+    {
+        os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << buffer->tid << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+        first = false;
+        for (auto& event : buffer->events)
+        {
+            os << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":";
+            printMicroseconds(os, event.startNs - traceStartNs);
+            os << ",\"dur\":";
+            printMicroseconds(os, event.durationNs);
+            os << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if (!event.detail.empty())
+            {
+                os << ",\"args\":{\"detail\":";
+                printJsonString(os, event.detail);
+                os << "}";
+            }
+            os << "}";
+        }
+    }
+    os << "\n]}" << std::endl;
+}
+
+uint64_t TraceSpan::now()
+{
+    return nowNs();
+}
+
+void TraceSpan::record()
+{
+    auto endNs = now();
+    getThreadBuffer().events.push_back(
+        TraceEvent{m_name, std::move(m_detail), m_startNs, endNs - m_startNs});
+}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "string_view.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace sk
+{
+namespace detail
+{
+extern std::atomic<bool> tracingEnabled;
+}
+
+/**
+ * Starts recording TraceSpans from every thread, dropping anything recorded before
+ */
+void startTracing();
+void stopTracing();
+
+inline bool isTracing()
+{
+    return detail::tracingEnabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Writes the recorded spans as Chrome trace event JSON, which chrome://tracing and Perfetto
+ * load. No thread may be recording while this runs
+ */
+void writeTrace(std::ostream& os);
+
+/**
+ * TraceSpan
+ *
+ * Records the enclosing scope as a complete event in the buffer of the current thread. Threads
+ * only ever write their own buffer, so recording takes no lock, and when tracing is off a span
+ * costs a relaxed load. name must outlive the trace, detail is copied
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name) : m_name(isTracing() ? name : nullptr)
+    {
+        if (m_name)
+        {
+            m_startNs = now();
+        }
+    }
+    TraceSpan(const char* name, string_view detail) : TraceSpan(name) { setDetail(detail); }
+    ~TraceSpan()
+    {
+        if (m_name)
+        {
+            record();
+        }
+    }
+    void operator=(const TraceSpan&) = delete;
+    TraceSpan(const TraceSpan&) = delete;
+
+    /**
+     * For details that are only known partway through the span, like a parsed name
+     */
+    void setDetail(string_view detail)
+    {
+        if (m_name)
+        {
+            m_detail.assign(detail.data(), detail.size());
+        }
+    }
+
+private:
+    static uint64_t now();
+    void record();
+
+    const char* const m_name;
+    std::string m_detail;
+    uint64_t m_startNs = 0;
+};
+}
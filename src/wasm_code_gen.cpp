@@ -1,12 +1,30 @@
 #include "wasm_code_gen.hpp"
+#include "wasm_runtime.hpp"
 #include "util/logger.hpp"
+#include <algorithm>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 
+using std::move;
 using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace
+{
+// Keep address 0 free so a null pointer never aliases a string
+const BinaryenIndex stringsBase = 16;
+const BinaryenIndex heapAlignment = 16;
+const BinaryenIndex pageSize = 65536;
+const BinaryenIndex maxMemoryPages = 65536;
+const char* const tailRecurseLabel = "tailrecurse";
+}
 
 namespace sk
 {
@@ -24,21 +42,98 @@ WasmCodeGen::WasmCodeGen() :
 void WasmCodeGen::visit(Module& module)
 {
     logi << "WasmCodegen::visit module";
-    dispatch(module.getMainBlock());
+
+    // Same rule as CodeGen, a module of only function definitions is a library without a main
+    auto& expressions = module.getMainBlock().getExpressions();
+    auto isLibrary = std::all_of(expressions.begin(), expressions.end(), [](Expr& e) {
+        return dynamic_cast<Function*>(&e) != nullptr;
+    });
+    if (isLibrary)
+    {
+        dispatch(module.getMainBlock());
+    }
+    else
+    {
+        m_function = FunctionState();
+        m_function.name = "main";
+        dispatch(module.getMainBlock());
+        addFunction(0, m_expr);
+        BinaryenAddFunctionExport(m_module, "main", "main");
+    }
+
+    // The allocator is only linked in for programs that call it
+    auto needsAllocator = false;
+    for (auto name : {wasmAllocFunction, wasmFreeFunction})
+    {
+        if (m_calledFunctions.count(name) && !m_definedFunctions.count(name))
+        {
+            needsAllocator = true;
+        }
+    }
+    if (needsAllocator)
+    {
+        addWasmAllocator(m_module, getHeapBase(), m_threads);
+        m_definedFunctions[wasmAllocFunction] = 1;
+        m_definedFunctions[wasmFreeFunction] = 1;
+    }
+
+    // Anything called but not defined here, including builtins like puts, comes from the host
+    for (auto& called : m_calledFunctions)
+    {
+        if (m_definedFunctions.find(called.first) == m_definedFunctions.end())
+        {
+            auto name = called.first.c_str();
+            BinaryenAddFunctionImport(m_module, name, "env", name, getFunctionType(called.second));
+        }
+    }
+    addMemory(needsAllocator || m_threads);
+
+    if (!BinaryenModuleValidate(m_module))
+    {
+        throw runtime_error("Generated wasm module failed validation");
+    }
 }
 
 void WasmCodeGen::visit(Block& block)
 {
     logi << "WasmCodegen::visit block";
-    for (auto& e : block.getExpressions())
+    // Only the last expression produces the value of the block, the rest are evaluated for
+    // their effects
+    auto isTailPosition = m_isTailPosition;
+    auto& expressions = block.getExpressions();
+    vector<BinaryenExpressionRef> children;
+    for (auto i = 0u; i < expressions.size(); ++i)
+    {
+        auto isLast = i + 1 == expressions.size();
+        m_isTailPosition = isTailPosition && isLast;
+        dispatch(expressions[i]);
+        children.push_back(isLast ? m_expr : BinaryenDrop(m_module, m_expr));
+    }
+    m_isTailPosition = false;
+
+    if (children.empty())
+    {
+        m_expr = BinaryenConst(m_module, BinaryenLiteralInt32(0));
+    }
+    else if (children.size() == 1)
+    {
+        m_expr = children.front();
+    }
+    else
     {
-        dispatch(e);
+        m_expr = BinaryenBlock(m_module, nullptr, children.data(), children.size(),
+                               BinaryenTypeAuto());
     }
 }
 
 void WasmCodeGen::visit(LetExpr& expr)
 {
     logi << "WasmCodegen::visit let";
+    m_isTailPosition = false;
+    dispatch(expr.getExpr());
+    auto index = addLocal();
+    m_function.symbols[expr.getIdentifier().getName()] = index;
+    m_expr = BinaryenLocalTee(m_module, index, m_expr);
 }
 
 void WasmCodeGen::visit(Expr& expr)
@@ -49,30 +144,190 @@ void WasmCodeGen::visit(Expr& expr)
 void WasmCodeGen::visit(Function& func)
 {
     logi << "WasmCodegen::visit function";
+    auto name = func.getName().to_string();
+    auto arity = func.getArgumentMatch().matches().size();
+    auto called = m_calledFunctions.find(name);
+    if (called != m_calledFunctions.end() && called->second != arity)
+    {
+        ostringstream ss;
+        ss << "Function " << name << " defined with " << arity << " parameters, but called with "
+           << called->second;
+        throw runtime_error(ss.str());
+    }
+    m_definedFunctions[name] = arity;
+
+    auto oldFunction = move(m_function);
+    m_function = FunctionState();
+    m_function.name = name;
+    for (auto& m : func.getArgumentMatch().matches())
+    {
+        auto& idMatch = dynamic_cast<const IdMatch&>(m.get());
+        m_function.symbols[idMatch.getId().getName()] = m_function.numParams++;
+    }
+
+    m_isTailPosition = true;
+    dispatch(func.getBlock());
+    m_isTailPosition = false;
+
+    auto body = m_expr;
+    if (m_function.hasTailRecursion)
+    {
+        // Self-recursive tail calls branch back here instead of growing the stack
+        body = BinaryenLoop(m_module, tailRecurseLabel, body);
+    }
+    addFunction(arity, body);
+    if (func.isExported())
+    {
+        BinaryenAddFunctionExport(m_module, name.c_str(), name.c_str());
+    }
+
+    m_function = move(oldFunction);
+    m_expr = BinaryenConst(m_module, BinaryenLiteralInt32(0));
 }
 
 void WasmCodeGen::visit(FunctionCall& call)
 {
+    logi << "WasmCodegen::visit function call";
+    auto isTailCall = m_isTailPosition;
+    m_isTailPosition = false;
+    auto name = call.getId().getName().to_string();
+    vector<BinaryenExpressionRef> operands;
+    for (auto& arg : call.getArguments())
+    {
+        dispatch(arg);
+        operands.push_back(m_expr);
+    }
+    if (m_threads && lowerAtomic(name, operands))
+    {
+        return;
+    }
+
+    auto defined = m_definedFunctions.find(name);
+    auto called = m_calledFunctions.find(name);
+    auto expectedArity = defined != m_definedFunctions.end()
+                             ? defined->second
+                             : called != m_calledFunctions.end() ? called->second
+                                                                 : operands.size();
+    if (operands.size() != expectedArity)
+    {
+        ostringstream ss;
+        ss << "Wrong number of arguments in call to " << name;
+        throw runtime_error(ss.str());
+    }
+    m_calledFunctions[name] = operands.size();
+
+    if (isTailCall && name == m_function.name && operands.size() == m_function.numParams)
+    {
+        // Arguments may read the current parameters, so evaluate all of them before
+        // overwriting any
+        vector<BinaryenExpressionRef> children;
+        vector<BinaryenIndex> temps;
+        for (auto operand : operands)
+        {
+            temps.push_back(addLocal());
+            children.push_back(BinaryenLocalSet(m_module, temps.back(), operand));
+        }
+        for (auto i = 0u; i < temps.size(); ++i)
+        {
+            children.push_back(BinaryenLocalSet(
+                m_module, i, BinaryenLocalGet(m_module, temps[i], BinaryenTypeInt32())));
+        }
+        children.push_back(BinaryenBreak(m_module, tailRecurseLabel, nullptr, nullptr));
+        m_function.hasTailRecursion = true;
+        m_expr = BinaryenBlock(m_module, nullptr, children.data(), children.size(),
+                               BinaryenTypeAuto());
+        return;
+    }
+
+    m_expr = BinaryenCall(m_module, name.c_str(), operands.data(), operands.size(),
+                          BinaryenTypeInt32());
 }
 
 void WasmCodeGen::visit(Identifier& variable)
 {
+    logi << "WasmCodegen::visit variable";
+    auto index = m_function.symbols.find(variable.getName());
+    if (index == m_function.symbols.end())
+    {
+        ostringstream ss;
+        ss << "Symbol not found: " << variable.getName();
+        throw runtime_error(ss.str());
+    }
+    m_expr = BinaryenLocalGet(m_module, index->second, BinaryenTypeInt32());
 }
 
 void WasmCodeGen::visit(I32Literal& i32Literal)
 {
+    logi << "WasmCodegen::visit i32 literal";
+    m_expr = BinaryenConst(m_module, BinaryenLiteralInt32(i32Literal.getValue()));
 }
 
 void WasmCodeGen::visit(StringLiteral& str)
 {
+    logi << "WasmCodegen::visit str literal";
+    auto address = stringsBase + m_stringsSize;
+    m_strings.emplace_back(str.getString().to_string());
+    m_stringsSize += m_strings.back().size() + 1;
+    m_expr = BinaryenConst(m_module, BinaryenLiteralInt32(address));
 }
 
 void WasmCodeGen::visit(BinaryOp& binOp)
 {
+    logi << "WasmCodegen::visit binary op";
+    m_isTailPosition = false;
+    dispatch(binOp.getLhs());
+    auto lhs = m_expr;
+    dispatch(binOp.getRhs());
+    auto rhs = m_expr;
+
+    auto op = binOp.getName();
+    switch (op[0])
+    {
+        case '+':
+            m_expr = BinaryenBinary(m_module, BinaryenAddInt32(), lhs, rhs);
+            break;
+        case '-':
+            m_expr = BinaryenBinary(m_module, BinaryenSubInt32(), lhs, rhs);
+            break;
+        case '*':
+            m_expr = BinaryenBinary(m_module, BinaryenMulInt32(), lhs, rhs);
+            break;
+        case '/':
+            m_expr = BinaryenBinary(m_module, BinaryenDivSInt32(), lhs, rhs);
+            break;
+        default:
+            loge << "unknown operator: " << op;
+            return;
+    }
+    if (m_debugInfo)
+    {
+        // Source maps count columns from 0, the lexer from 1
+        auto token = binOp.getToken();
+        m_function.debugLocations.push_back(
+            {m_expr, static_cast<BinaryenIndex>(token.getLine()),
+             static_cast<BinaryenIndex>(token.getCol() - 1)});
+    }
 }
 
 void WasmCodeGen::visit(IfExpr& expr)
 {
+    logi << "WasmCodegen::visit if";
+    auto isTailPosition = m_isTailPosition;
+    m_isTailPosition = false;
+    // Wasm treats any nonzero i32 as true, same as comparing against 0 in CodeGen
+    dispatch(*expr.getCondition());
+    auto condition = m_expr;
+
+    m_isTailPosition = isTailPosition;
+    dispatch(*expr.getThenBlock());
+    auto thenExpr = m_expr;
+
+    m_isTailPosition = isTailPosition;
+    dispatch(*expr.getElseBlock());
+    auto elseExpr = m_expr;
+    m_isTailPosition = false;
+
+    m_expr = BinaryenIf(m_module, condition, thenExpr, elseExpr);
 }
 
 void WasmCodeGen::visit(Match& match)
@@ -91,9 +346,128 @@ void WasmCodeGen::visit(TypeMatch& match)
 {
 }
 
+void WasmCodeGen::enableDebugInfo(string_view sourceFile)
+{
+    m_debugInfo = true;
+    m_debugFileIndex =
+        BinaryenModuleAddDebugInfoFileName(m_module, sourceFile.to_string().c_str());
+}
+
+void WasmCodeGen::enableThreads()
+{
+    m_threads = true;
+    BinaryenModuleSetFeatures(m_module,
+                              BinaryenModuleGetFeatures(m_module) | BinaryenFeatureAtomics());
+}
+
 void WasmCodeGen::printIr()
 {
     BinaryenModulePrint(m_module);
 }
+
+BinaryenFunctionTypeRef WasmCodeGen::getFunctionType(size_t arity)
+{
+    auto type = m_functionTypes.find(arity);
+    if (type != m_functionTypes.end())
+    {
+        return type->second;
+    }
+    vector<BinaryenType> params(arity, BinaryenTypeInt32());
+    auto name = "i32_" + std::to_string(arity);
+    auto functionType = BinaryenAddFunctionType(m_module, name.c_str(), BinaryenTypeInt32(),
+                                                params.data(), params.size());
+    m_functionTypes[arity] = functionType;
+    return functionType;
+}
+
+BinaryenIndex WasmCodeGen::addLocal()
+{
+    m_function.varTypes.push_back(BinaryenTypeInt32());
+    return m_function.numParams + m_function.varTypes.size() - 1;
+}
+
+void WasmCodeGen::addFunction(size_t arity, BinaryenExpressionRef body)
+{
+    auto function =
+        BinaryenAddFunction(m_module, m_function.name.c_str(), getFunctionType(arity),
+                            m_function.varTypes.data(), m_function.varTypes.size(), body);
+    for (auto& location : m_function.debugLocations)
+    {
+        BinaryenFunctionSetDebugLocation(function, location.expr, m_debugFileIndex,
+                                         location.line, location.column);
+    }
+}
+
+bool WasmCodeGen::lowerAtomic(const string& name, vector<BinaryenExpressionRef>& operands)
+{
+    // Builtins operating on an i32 in linear memory, the read-modify-write forms return the old
+    // value
+    static const std::map<string, size_t> arities = {
+        {"atomic_load", 1}, {"atomic_store", 2}, {"atomic_add", 2}, {"atomic_cas", 3}};
+    auto arity = arities.find(name);
+    if (arity == arities.end())
+    {
+        return false;
+    }
+    if (operands.size() != arity->second)
+    {
+        ostringstream ss;
+        ss << "Wrong number of arguments in call to " << name;
+        throw runtime_error(ss.str());
+    }
+
+    auto i32 = BinaryenTypeInt32();
+    if (name == "atomic_load")
+    {
+        m_expr = BinaryenAtomicLoad(m_module, 4, 0, i32, operands[0]);
+    }
+    else if (name == "atomic_store")
+    {
+        BinaryenExpressionRef children[] = {
+            BinaryenAtomicStore(m_module, 4, 0, operands[0], operands[1], i32),
+            BinaryenConst(m_module, BinaryenLiteralInt32(0))};
+        m_expr = BinaryenBlock(m_module, nullptr, children, 2, i32);
+    }
+    else if (name == "atomic_add")
+    {
+        m_expr = BinaryenAtomicRMW(m_module, BinaryenAtomicRMWAdd(), 4, 0, operands[0],
+                                   operands[1], i32);
+    }
+    else
+    {
+        m_expr = BinaryenAtomicCmpxchg(m_module, 4, 0, operands[0], operands[1], operands[2], i32);
+    }
+    return true;
 }
 
+BinaryenIndex WasmCodeGen::getHeapBase() const
+{
+    return (stringsBase + m_stringsSize + heapAlignment - 1) & ~(heapAlignment - 1);
+}
+
+void WasmCodeGen::addMemory(bool hasHeap)
+{
+    if (m_strings.empty() && !hasHeap)
+    {
+        return;
+    }
+
+    // One segment holding every string, each null terminated for the host
+    string data;
+    for (auto& s : m_strings)
+    {
+        data += s;
+        data.push_back('\0');
+    }
+    const char* segments[] = { data.data() };
+    int8_t segmentPassive[] = { 0 };
+    BinaryenExpressionRef segmentOffsets[] = {
+        BinaryenConst(m_module, BinaryenLiteralInt32(stringsBase)) };
+    BinaryenIndex segmentSizes[] = { static_cast<BinaryenIndex>(data.size()) };
+    auto numSegments = m_strings.empty() ? 0 : 1;
+    auto end = hasHeap ? getHeapBase() + wasmHeapMetadataSize : stringsBase + segmentSizes[0];
+    auto initialPages = (end + pageSize - 1) / pageSize;
+    BinaryenSetMemory(m_module, initialPages, maxMemoryPages, "memory", segments, segmentPassive,
+                      segmentOffsets, segmentSizes, numSegments, m_threads);
+}
+}
@@ -3,6 +3,8 @@
 #include <binaryen-c.h>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace sk
 {
@@ -40,18 +42,64 @@ public:
     void visit(TupleMatch& match) override;
     void visit(TypeMatch& match) override;
 
-    //std::map<string_view, llvm::Value*> m_symbols;
-    //std::map<string_view, llvm::Value*> m_functions;
-    //Block* m_block = nullptr;
-    //llvm::Value* m_value = nullptr;
-    //llvm::LLVMContext m_llvmContext;
-    //llvm::IRBuilder<> m_irBuilder;
-    //std::unique_ptr<llvm::Module> m_module;
+    /**
+     * Attach source locations to generated expressions so a source map can be written
+     */
+    void enableDebugInfo(string_view sourceFile);
+    /**
+     * Share linear memory between threads, make the allocator thread safe and lower the
+     * atomic_load, atomic_store, atomic_add and atomic_cas builtins to wasm atomics
+     */
+    void enableThreads();
 
+    BinaryenModuleRef getBinaryenModule() { return m_module; }
     void printIr();
 
 private:
+    struct DebugLocation
+    {
+        BinaryenExpressionRef expr;
+        BinaryenIndex line;
+        BinaryenIndex column;
+    };
+
+    // Locals of the function currently being generated, parameters come first
+    struct FunctionState
+    {
+        std::map<string_view, BinaryenIndex> symbols;
+        std::vector<BinaryenType> varTypes;
+        BinaryenIndex numParams = 0;
+        std::string name;
+        bool hasTailRecursion = false;
+        std::vector<DebugLocation> debugLocations;
+    };
+
+    BinaryenFunctionTypeRef getFunctionType(size_t arity);
+    BinaryenIndex addLocal();
+    void addFunction(size_t arity, BinaryenExpressionRef body);
+    bool lowerAtomic(const std::string& name, std::vector<BinaryenExpressionRef>& operands);
+    BinaryenIndex getHeapBase() const;
+    void addMemory(bool hasHeap);
+
     BinaryenModuleRef m_module;
     BinaryenModuleRelease m_moduleRelease;
+    BinaryenExpressionRef m_expr = nullptr;
+
+    FunctionState m_function;
+    bool m_isTailPosition = false;
+
+    bool m_threads = false;
+    bool m_debugInfo = false;
+    BinaryenIndex m_debugFileIndex = 0;
+
+    std::map<size_t, BinaryenFunctionTypeRef> m_functionTypes;
+    // Arity of every function defined in the module and of every other function called
+    std::map<std::string, size_t> m_definedFunctions;
+    std::map<std::string, size_t> m_calledFunctions;
+
+    // String literals are laid out back to back in linear memory near address 0, the heap
+    // follows them
+    std::vector<std::string> m_strings;
+    BinaryenIndex m_stringsSize = 0;
 };
 }
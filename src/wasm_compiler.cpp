@@ -1,39 +1,274 @@
 #include "wasm_compiler.hpp"
-#include "ast_printer.hpp"
+#include "wasm_layout.hpp"
+#include "wasm_runner.hpp"
 #include "util/logger.hpp"
+#include <wasm.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <regex>
+#include <set>
+#include <utility>
+#include <vector>
 
+using std::ofstream;
 using std::ostream;
+using std::ostringstream;
+using std::pair;
+using std::regex;
+using std::regex_replace;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace
+{
+const uint8_t codeSectionId = 10;
+const size_t wasmHeaderSize = 8;
+
+void writeFile(const string& filename, const char* data, size_t size)
+{
+    ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(data, size);
+    out.close();
+    if (!out)
+    {
+        ostringstream ss;
+        ss << "Could not write " << filename;
+        throw runtime_error(ss.str());
+    }
+}
+
+uint32_t readLeb(const uint8_t*& pos, const uint8_t* end)
+{
+    uint32_t value = 0;
+    for (auto shift = 0; pos < end; shift += 7)
+    {
+        auto byte = *pos++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    throw runtime_error("Truncated LEB128 in wasm binary");
+}
+}
 
 namespace sk
 {
-WasmCompiler::WasmCompiler(const char* filename)
+WasmCompiler::WasmCompiler(const char* filename, const WasmCompilerOptions& options)
     : m_filename(filename),
-      m_source(SourceBuffer::readFile(filename)),
-      m_lexer(m_source),
-      m_module(filename),
-      m_parser(m_module, m_lexer),
+      m_options(options),
+      m_frontendOwner(Frontend::read(filename, options.timeReport)),
+      m_frontend(*m_frontendOwner),
+      m_codeGen()
+{
+    enableOptions();
+}
+
+WasmCompiler::WasmCompiler(Frontend& frontend, const WasmCompilerOptions& options)
+    : m_filename(frontend.getFilename()),
+      m_options(options),
+      m_frontendOwner(nullptr),
+      m_frontend(frontend),
       m_codeGen()
 {
+    enableOptions();
 }
 
 void WasmCompiler::compile()
 {
-    m_parser.parse();
-    m_codeGen.dispatch(m_module);
+    auto timeReport = m_options.timeReport;
+    if (m_frontendOwner && timeReport)
+    {
+        m_frontend.parse(*timeReport);
+    }
+    else if (m_frontendOwner)
+    {
+        m_frontend.parse();
+    }
+    {
+        TimePhase phase(timeReport, "codegen");
+        m_codeGen.dispatch(m_frontend.getModule());
+    }
+    TimePhase phase(timeReport, "optimize");
+    optimize();
+    applyProfile();
 }
 
 void WasmCompiler::printAst(ostream& os)
 {
-    AstPrinter printer(os);
-    printer.dispatch(m_module);
+    m_frontend.printAst(os);
 }
 
 void WasmCompiler::printIr()
 {
     m_codeGen.printIr();
 }
+
+void WasmCompiler::buildWasmFile(ostream* sizeReport)
+{
+    auto filename = getOutputFilename();
+    auto sourceMapFilename = filename + ".map";
+    // The url is resolved relative to the wasm file, so only the basename goes in the binary
+    auto sourceMapUrl = regex_replace(sourceMapFilename, regex(".*/"), "");
+
+    TimePhase phase(m_options.timeReport, "emit");
+    auto result = BinaryenModuleAllocateAndWrite(
+        m_codeGen.getBinaryenModule(), m_options.sourceMap ? sourceMapUrl.c_str() : nullptr);
+    std::unique_ptr<void, decltype(&std::free)> binary(result.binary, &std::free);
+    std::unique_ptr<char, decltype(&std::free)> sourceMap(result.sourceMap, &std::free);
+
+    logi << "Writing " << result.binaryBytes << " bytes to " << filename;
+    writeFile(filename, static_cast<const char*>(binary.get()), result.binaryBytes);
+    phase.setCount(result.binaryBytes, "bytes");
+    if (sourceMap)
+    {
+        writeFile(sourceMapFilename, sourceMap.get(), std::strlen(sourceMap.get()));
+    }
+    if (m_coldModule)
+    {
+        auto coldFilename = regex_replace(filename, regex("\\.wasm$"), "") + ".cold.wasm";
+        auto cold = BinaryenModuleAllocateAndWrite(m_coldModule, nullptr);
+        std::unique_ptr<void, decltype(&std::free)> coldBinary(cold.binary, &std::free);
+        logi << "Writing " << cold.binaryBytes << " bytes to " << coldFilename;
+        writeFile(coldFilename, static_cast<const char*>(coldBinary.get()), cold.binaryBytes);
+    }
+    if (sizeReport)
+    {
+        printSizeReport(*sizeReport, static_cast<const uint8_t*>(binary.get()),
+                        result.binaryBytes);
+    }
+}
+
+void WasmCompiler::run(ostream& report)
+{
+    WasmRunner runner(m_codeGen.getBinaryenModule());
+    auto result = runner.run();
+    report << result;
+    if (!m_options.profileGeneratePath.empty())
+    {
+        writeWasmProfile(m_options.profileGeneratePath, result.firstCalls);
+    }
+}
+
+void WasmCompiler::enableOptions()
+{
+    if (m_options.sourceMap)
+    {
+        m_codeGen.enableDebugInfo(m_filename);
+    }
+    if (m_options.simd)
+    {
+        auto module = m_codeGen.getBinaryenModule();
+        BinaryenModuleSetFeatures(module,
+                                  BinaryenModuleGetFeatures(module) | BinaryenFeatureSIMD128());
+    }
+    if (m_options.threads)
+    {
+        m_codeGen.enableThreads();
+    }
+}
+
+void WasmCompiler::optimize()
+{
+    if (m_options.optLevel == 0 && m_options.shrinkLevel == 0)
+    {
+        return;
+    }
+    // Binaryen keeps these as global pass options for every module
+    BinaryenSetOptimizeLevel(m_options.optLevel);
+    BinaryenSetShrinkLevel(m_options.shrinkLevel);
+    // Passes drop debug locations unless asked to keep them
+    BinaryenSetDebugInfo(m_options.sourceMap);
+    BinaryenModuleOptimize(m_codeGen.getBinaryenModule());
+}
+
+void WasmCompiler::applyProfile()
+{
+    if (m_options.profileUsePath.empty())
+    {
+        return;
+    }
+    auto firstCalls = readWasmProfile(m_options.profileUsePath);
+    orderWasmFunctions(m_codeGen.getBinaryenModule(), firstCalls);
+    if (m_options.splitCold)
+    {
+        m_coldModule = splitColdWasmFunctions(
+            m_codeGen.getBinaryenModule(), std::set<string>(firstCalls.begin(), firstCalls.end()));
+        m_coldModuleRelease.reset(new BinaryenModuleRelease(m_coldModule));
+    }
+}
+
+void WasmCompiler::printSizeReport(ostream& os, const uint8_t* binary, size_t size)
+{
+    // The binary writer numbers imported functions first, then defined functions in module
+    // order, and the code section only has bodies for the defined ones
+    auto& wasmModule = *static_cast<wasm::Module*>(m_codeGen.getBinaryenModule());
+    vector<string> names;
+    for (auto& func : wasmModule.functions)
+    {
+        if (!func->imported())
+        {
+            names.emplace_back(func->name.str);
+        }
+    }
+
+    vector<pair<uint32_t, string>> functionSizes;
+    auto pos = binary + wasmHeaderSize;
+    auto end = binary + size;
+    while (pos < end)
+    {
+        auto sectionId = *pos++;
+        auto sectionSize = readLeb(pos, end);
+        auto sectionEnd = pos + sectionSize;
+        if (sectionId == codeSectionId)
+        {
+            auto count = readLeb(pos, end);
+            for (auto i = 0u; i < count; ++i)
+            {
+                auto bodySize = readLeb(pos, sectionEnd);
+                functionSizes.emplace_back(bodySize,
+                                           i < names.size() ? names[i] : "<unnamed>");
+                pos += bodySize;
+            }
+        }
+        pos = sectionEnd;
+    }
+
+    std::stable_sort(functionSizes.begin(), functionSizes.end(),
+                     [](const pair<uint32_t, string>& a, const pair<uint32_t, string>& b) {
+                         return a.first > b.first;
+                     });
+    uint32_t codeSize = 0;
+    for (auto& f : functionSizes)
+    {
+        codeSize += f.first;
+    }
+
+    os << std::setw(10) << "bytes" << std::setw(8) << "%" << "  function" << '\n';
+    for (auto& f : functionSizes)
+    {
+        os << std::setw(10) << f.first << std::setw(7) << std::fixed << std::setprecision(1)
+           << (codeSize ? 100.0 * f.first / codeSize : 0.0) << "%  " << f.second << '\n';
+    }
+    os << std::setw(10) << codeSize << "  code total\n";
+    os << std::setw(10) << size << "  file total" << std::endl;
+}
+
+string WasmCompiler::getOutputFilename() const
+{
+    if (!m_options.outputPath.empty())
+    {
+        return m_options.outputPath;
+    }
+    return regex_replace(m_filename, regex("sk$"), "wasm");
+}
 }
@@ -1,29 +1,83 @@
 #pragma once
 #include "wasm_code_gen.hpp"
-#include "source.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
+#include "frontend.hpp"
 #include "util/string_view.hpp"
+#include "util/time_report.hpp"
 #include <ostream>
 #include <memory>
+#include <string>
 
 namespace sk
 {
+struct WasmCompilerOptions
+{
+    // 0-4, same meaning as wasm-opt's -O levels
+    int optLevel = 0;
+    // 0-2, 1 is -Os and 2 is -Oz
+    int shrinkLevel = 0;
+
+    // Allow Binaryen to emit and validate v128 instructions. Only engines with the SIMD proposal
+    // enabled can load the output
+    bool simd = false;
+
+    // Shared memory, atomics and a thread safe allocator, so several workers can instantiate the
+    // module on the same memory
+    bool threads = false;
+
+    // Also write <output>.map mapping wasm code offsets back to the source
+    bool sourceMap = false;
+
+    // --run writes the functions in first call order here
+    std::string profileGeneratePath;
+    // Lay out functions in the order of a profile written by profileGeneratePath
+    std::string profileUsePath;
+    // With profileUsePath, move functions the profile never called to <output>.cold.wasm. It is
+    // instantiated after the main module, with that module's exports as "skiff_hot"
+    bool splitCold = false;
+
+    // Defaults to the input filename with a .wasm extension
+    std::string outputPath;
+
+    // Receives the timing of every phase when set
+    TimeReport* timeReport = nullptr;
+};
+
 class WasmCompiler
 {
 public:
-    WasmCompiler(const char* filename);
+    WasmCompiler(const char* filename, const WasmCompilerOptions& options = WasmCompilerOptions());
+    /**
+     * Generates code from a Frontend that has already parsed its file, so other backends can
+     * share the parse
+     */
+    WasmCompiler(Frontend& frontend, const WasmCompilerOptions& options = WasmCompilerOptions());
 
     void compile();
     void printAst(std::ostream& out);
     void printIr();
+    /**
+     * Writes the binary module, and prints the code size of every function if sizeReport is set
+     */
+    void buildWasmFile(std::ostream* sizeReport = nullptr);
+    /**
+     * Runs main in the wasm interpreter and prints its result, wall time and counts. The module
+     * is instrumented in the process, so build artifacts first
+     */
+    void run(std::ostream& report);
 
 private:
+    void enableOptions();
+    void optimize();
+    void applyProfile();
+    void printSizeReport(std::ostream& os, const uint8_t* binary, size_t size);
+    std::string getOutputFilename() const;
+
     const char* const m_filename;
-    SourceBuffer m_source;
-    Lexer m_lexer;
-    Module m_module;
-    Parser m_parser;
+    const WasmCompilerOptions m_options;
+    const std::unique_ptr<Frontend> m_frontendOwner;
+    Frontend& m_frontend;
     WasmCodeGen m_codeGen;
+    BinaryenModuleRef m_coldModule = nullptr;
+    std::unique_ptr<BinaryenModuleRelease> m_coldModuleRelease;
 };
 }
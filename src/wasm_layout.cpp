@@ -0,0 +1,265 @@
+#include "wasm_layout.hpp"
+#include "util/logger.hpp"
+#include <ir/find_all.h>
+#include <ir/module-utils.h>
+#include <wasm.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using std::ifstream;
+using std::map;
+using std::ofstream;
+using std::ostringstream;
+using std::runtime_error;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace
+{
+const char* const hotModuleName = "skiff_hot";
+
+void copyFunctionType(wasm::Module& from, wasm::Module& to, wasm::Name name)
+{
+    if (name.is() && !to.getFunctionTypeOrNull(name))
+    {
+        to.addFunctionType(std::make_unique<wasm::FunctionType>(*from.getFunctionType(name)));
+    }
+}
+
+/**
+ * Name the function is exported under, exporting it first if it isn't yet
+ */
+wasm::Name exportFunction(wasm::Module& module, wasm::Name name)
+{
+    for (auto& e : module.exports)
+    {
+        if (e->kind == wasm::ExternalKind::Function && e->value == name)
+        {
+            return e->name;
+        }
+    }
+    string exportName = name.str;
+    while (module.getExportOrNull(exportName))
+    {
+        exportName += "$hot";
+    }
+    auto e = new wasm::Export;
+    e->name = exportName;
+    e->value = name;
+    e->kind = wasm::ExternalKind::Function;
+    module.addExport(e);
+    return e->name;
+}
+
+/**
+ * Name the table is exported under, exporting it first if it isn't yet
+ */
+wasm::Name exportTable(wasm::Module& module)
+{
+    for (auto& e : module.exports)
+    {
+        if (e->kind == wasm::ExternalKind::Table)
+        {
+            return e->name;
+        }
+    }
+    string exportName = "table";
+    while (module.getExportOrNull(exportName))
+    {
+        exportName += "$hot";
+    }
+    auto e = new wasm::Export;
+    e->name = exportName;
+    e->value = module.table.name;
+    e->kind = wasm::ExternalKind::Table;
+    module.addExport(e);
+    return e->name;
+}
+}
+
+namespace sk
+{
+vector<string> readWasmProfile(const string& filename)
+{
+    ifstream in(filename);
+    if (!in)
+    {
+        ostringstream ss;
+        ss << "Could not read profile " << filename;
+        throw runtime_error(ss.str());
+    }
+    vector<string> firstCalls;
+    for (string line; std::getline(in, line);)
+    {
+        if (!line.empty())
+        {
+            firstCalls.push_back(line);
+        }
+    }
+    return firstCalls;
+}
+
+void writeWasmProfile(const string& filename, const vector<string>& firstCalls)
+{
+    ofstream out(filename);
+    for (auto& name : firstCalls)
+    {
+        out << name << '\n';
+    }
+    out.close();
+    if (!out)
+    {
+        ostringstream ss;
+        ss << "Could not write profile " << filename;
+        throw runtime_error(ss.str());
+    }
+}
+
+void orderWasmFunctions(BinaryenModuleRef module, const vector<string>& order)
+{
+    auto& wasmModule = *static_cast<wasm::Module*>(module);
+    map<string, size_t> rank;
+    for (auto i = 0u; i < order.size(); ++i)
+    {
+        rank.emplace(order[i], i);
+    }
+    // The binary writer numbers imports first anyway, so only defined functions move
+    std::stable_sort(wasmModule.functions.begin(), wasmModule.functions.end(),
+                     [&rank, &order](const std::unique_ptr<wasm::Function>& a,
+                                     const std::unique_ptr<wasm::Function>& b) {
+                         auto aRank = rank.find(a->name.str);
+                         auto bRank = rank.find(b->name.str);
+                         return (aRank == rank.end() ? order.size() : aRank->second) <
+                                (bRank == rank.end() ? order.size() : bRank->second);
+                     });
+}
+
+BinaryenModuleRef splitColdWasmFunctions(BinaryenModuleRef module, const set<string>& hot)
+{
+    auto& primary = *static_cast<wasm::Module*>(module);
+    auto secondaryRef = BinaryenModuleCreate();
+    auto& secondary = *static_cast<wasm::Module*>(secondaryRef);
+    secondary.features = primary.features;
+
+    vector<wasm::Function*> cold;
+    for (auto& func : primary.functions)
+    {
+        if (!func->imported() && !hot.count(func->name.str))
+        {
+            cold.push_back(func.get());
+        }
+    }
+    logi << "Moving " << cold.size() << " cold functions to a secondary module";
+
+    // Cold functions get slots after whatever the table held already. The primary leaves them
+    // empty and the secondary's element segment fills them in when it is instantiated
+    auto firstSlot = primary.table.exists ? uint32_t(primary.table.initial) : 0u;
+    primary.table.exists = true;
+    primary.table.initial = firstSlot + cold.size();
+    if (primary.table.max < primary.table.initial)
+    {
+        primary.table.max = primary.table.initial;
+    }
+    auto tableExport = exportTable(primary);
+    secondary.table.exists = true;
+    secondary.table.initial = primary.table.initial;
+    secondary.table.max = primary.table.max;
+    secondary.table.module = hotModuleName;
+    secondary.table.base = tableExport;
+    wasm::Table::Segment segment;
+    segment.offset =
+        static_cast<wasm::Expression*>(BinaryenConst(secondaryRef, BinaryenLiteralInt32(firstSlot)));
+
+    for (auto i = 0u; i < cold.size(); ++i)
+    {
+        auto func = cold[i];
+        if (!func->type.is())
+        {
+            ostringstream ss;
+            ss << "Cold function " << func->name.str << " has no function type";
+            throw runtime_error(ss.str());
+        }
+        auto copy = wasm::ModuleUtils::copyFunction(func, secondary);
+        copy->type = func->type;
+        copyFunctionType(primary, secondary, func->type);
+        segment.data.push_back(func->name);
+
+        // Keep the name and signature, so calls and exports in the primary module still resolve,
+        // and forward to the table slot
+        vector<BinaryenExpressionRef> arguments;
+        for (auto param = 0u; param < func->params.size(); ++param)
+        {
+            arguments.push_back(BinaryenLocalGet(module, param, func->params[param]));
+        }
+        auto slot = BinaryenConst(module, BinaryenLiteralInt32(firstSlot + i));
+        func->body = static_cast<wasm::Expression*>(BinaryenCallIndirect(
+            module, slot, arguments.data(), arguments.size(), func->type.str));
+        func->vars.clear();
+        func->localNames.clear();
+        func->localIndices.clear();
+        func->debugLocations.clear();
+    }
+    secondary.table.segments.push_back(segment);
+
+    // Whatever the cold functions call that stayed behind comes from the primary module
+    set<wasm::Name> imported;
+    for (auto func : cold)
+    {
+        auto& body = secondary.getFunction(func->name)->body;
+        for (auto call : wasm::FindAll<wasm::Call>(body).list)
+        {
+            if (secondary.getFunctionOrNull(call->target) || imported.count(call->target))
+            {
+                continue;
+            }
+            imported.insert(call->target);
+            auto target = primary.getFunction(call->target);
+            auto import = new wasm::Function;
+            import->name = target->name;
+            if (target->imported())
+            {
+                import->module = target->module;
+                import->base = target->base;
+            }
+            else
+            {
+                import->module = hotModuleName;
+                import->base = exportFunction(primary, target->name);
+            }
+            import->type = target->type;
+            import->params = target->params;
+            import->result = target->result;
+            copyFunctionType(primary, secondary, target->type);
+            secondary.addFunction(import);
+        }
+    }
+
+    if (primary.memory.exists)
+    {
+        for (auto& e : primary.exports)
+        {
+            if (e->kind == wasm::ExternalKind::Memory)
+            {
+                secondary.memory.exists = true;
+                secondary.memory.initial = primary.memory.initial;
+                secondary.memory.max = primary.memory.max;
+                secondary.memory.shared = primary.memory.shared;
+                secondary.memory.module = hotModuleName;
+                secondary.memory.base = e->name;
+            }
+        }
+    }
+
+    if (!BinaryenModuleValidate(module) || !BinaryenModuleValidate(secondaryRef))
+    {
+        BinaryenModuleDispose(secondaryRef);
+        throw runtime_error("Split wasm modules failed validation");
+    }
+    return secondaryRef;
+}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <binaryen-c.h>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace sk
+{
+/**
+ * Function order profiles are text files with one function name per line, in first call order
+ */
+std::vector<std::string> readWasmProfile(const std::string& filename);
+void writeWasmProfile(const std::string& filename, const std::vector<std::string>& firstCalls);
+
+/**
+ * Moves the listed functions to the front of the code section in the given order, the rest keep
+ * their relative order after them. Engines that compile while streaming can then start running
+ * the hot functions before the module has finished downloading.
+ */
+void orderWasmFunctions(BinaryenModuleRef module, const std::vector<std::string>& order);
+
+/**
+ * Moves every defined function that isn't hot into a new module and returns it, the caller owns
+ * it. The primary module instantiates on its own: each moved function is left behind as a stub
+ * that calls through an empty slot of the exported table, and traps until the secondary module is
+ * loaded. The secondary module imports the table, the memory and the primary functions it calls
+ * from "skiff_hot", which the primary module exports, and its element segment fills in the slots
+ * when it is instantiated.
+ */
+BinaryenModuleRef splitColdWasmFunctions(BinaryenModuleRef module,
+                                         const std::set<std::string>& hot);
+}
@@ -0,0 +1,229 @@
+#include "wasm_runner.hpp"
+#include "util/logger.hpp"
+#include <ir/iteration.h>
+#include <ir/module-utils.h>
+#include <shell-interface.h>
+#include <wasm-builder.h>
+#include <wasm-interpreter.h>
+#include <wasm-traversal.h>
+#include <wasm.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::map;
+using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace
+{
+const char* const opsImport = "skiff_ops";
+const char* const enterImport = "skiff_enter";
+
+/**
+ * Host side of a run, provides puts and receives counts from the instrumentation
+ */
+class RunnerInterface : public wasm::ShellExternalInterface
+{
+public:
+    RunnerInterface(const vector<string>& functionNames, ostream& out)
+        : m_functionNames(functionNames), m_out(out)
+    {
+    }
+
+    wasm::Literal callImport(wasm::Function* import, wasm::LiteralList& arguments) override
+    {
+        if (import->module == "skiff" && import->base == "ops")
+        {
+            instructions += arguments[0].geti32();
+            return wasm::Literal();
+        }
+        if (import->module == "skiff" && import->base == "enter")
+        {
+            auto& name = m_functionNames.at(arguments[0].geti32());
+            if (++calls[name] == 1)
+            {
+                firstCalls.push_back(name);
+            }
+            return wasm::Literal();
+        }
+        if (import->module == "env" && import->base == "puts")
+        {
+            string s;
+            for (auto address = uint32_t(arguments[0].geti32()); auto c = load8u(address);
+                 ++address)
+            {
+                s.push_back(c);
+            }
+            m_out << s << std::endl;
+            return wasm::Literal(int32_t(s.size() + 1));
+        }
+        trap((string("unknown import ") + import->module.str + "." + import->base.str).c_str());
+        return wasm::Literal();
+    }
+
+    uint64_t instructions = 0;
+    map<string, uint64_t> calls;
+    vector<string> firstCalls;
+
+private:
+    const vector<string>& m_functionNames;
+    ostream& m_out;
+};
+
+/**
+ * Instructions in expr, not counting the arms of ifs or the bodies of loops, which are counted
+ * separately when they run
+ */
+uint32_t countRegion(wasm::Expression* expr)
+{
+    uint32_t count = 1;
+    for (auto child : wasm::ChildIterator(expr))
+    {
+        auto isIfArm = expr->is<wasm::If>() && child != expr->cast<wasm::If>()->condition;
+        auto isLoopBody = expr->is<wasm::Loop>();
+        if (!isIfArm && !isLoopBody)
+        {
+            count += countRegion(child);
+        }
+    }
+    return count;
+}
+
+/**
+ * Prefixes every region with a call reporting how many instructions it has
+ */
+struct OpCountInstrumenter : public wasm::PostWalker<OpCountInstrumenter>
+{
+    OpCountInstrumenter(wasm::Module& wasmModule) : builder(wasmModule) {}
+
+    wasm::Expression* countOps(wasm::Expression* region)
+    {
+        vector<wasm::Expression*> args = {
+            builder.makeConst(wasm::Literal(int32_t(countRegion(region))))};
+        return builder.makeSequence(builder.makeCall(opsImport, args, wasm::none), region);
+    }
+
+    void visitIf(wasm::If* curr)
+    {
+        curr->ifTrue = countOps(curr->ifTrue);
+        if (curr->ifFalse)
+        {
+            curr->ifFalse = countOps(curr->ifFalse);
+        }
+    }
+
+    void visitLoop(wasm::Loop* curr) { curr->body = countOps(curr->body); }
+
+    wasm::Builder builder;
+};
+}
+
+namespace sk
+{
+ostream& operator<<(ostream& os, const WasmRunResult& result)
+{
+    os << "main returned " << result.returnValue << '\n';
+    os << "wall time: " << std::fixed << std::setprecision(6) << result.seconds << " s\n";
+    os << "instructions: " << result.instructions << '\n';
+    os << "calls:\n";
+    for (auto& call : result.calls)
+    {
+        os << std::setw(12) << call.second << "  " << call.first << '\n';
+    }
+    return os;
+}
+
+WasmRunResult WasmRunner::run()
+{
+    auto& wasmModule = *static_cast<wasm::Module*>(m_module);
+    if (!wasmModule.getExportOrNull("main"))
+    {
+        throw runtime_error("Module has no main to run");
+    }
+
+    logi << "Running main in the wasm interpreter";
+    WasmRunResult result;
+    // The counts come from an instrumented copy, so the module is left as it was and the timed
+    // run measures the code the backend produced. That run's output is discarded, so main's
+    // output only appears once
+    wasm::Module counted;
+    wasm::ModuleUtils::copyModule(wasmModule, counted);
+    auto functionNames = instrument(counted);
+    try
+    {
+        {
+            RunnerInterface interface(functionNames, m_out);
+            wasm::ModuleInstance instance(counted, &interface);
+            wasm::LiteralList noArguments;
+            result.returnValue = instance.callExport("main", noArguments).geti32();
+            result.instructions = interface.instructions;
+            result.calls = std::move(interface.calls);
+            result.firstCalls = std::move(interface.firstCalls);
+        }
+        {
+            std::ostream nullOut(nullptr);
+            RunnerInterface interface(functionNames, nullOut);
+            wasm::ModuleInstance instance(wasmModule, &interface);
+            wasm::LiteralList noArguments;
+            auto start = std::chrono::steady_clock::now();
+            instance.callExport("main", noArguments);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            result.seconds = elapsed.count();
+        }
+    }
+    catch (const wasm::TrapException&)
+    {
+        throw runtime_error("Wasm module trapped");
+    }
+    return result;
+}
+
+vector<string> WasmRunner::instrument(wasm::Module& wasmModule)
+{
+    auto module = static_cast<BinaryenModuleRef>(&wasmModule);
+    BinaryenType params[] = {BinaryenTypeInt32()};
+    auto countType =
+        BinaryenAddFunctionType(module, "skiff_count", BinaryenTypeNone(), params, 1);
+
+    // enter reports the index into the returned names
+    vector<string> functionNames;
+    vector<wasm::Function*> definedFunctions;
+    for (auto& func : wasmModule.functions)
+    {
+        functionNames.emplace_back(func->name.str);
+        definedFunctions.push_back(func->imported() ? nullptr : func.get());
+    }
+    BinaryenAddFunctionImport(module, opsImport, "skiff", "ops", countType);
+    BinaryenAddFunctionImport(module, enterImport, "skiff", "enter", countType);
+
+    OpCountInstrumenter instrumenter(wasmModule);
+    auto& builder = instrumenter.builder;
+    for (auto i = 0u; i < definedFunctions.size(); ++i)
+    {
+        auto func = definedFunctions[i];
+        if (!func)
+        {
+            continue;
+        }
+        instrumenter.walkFunctionInModule(func, &wasmModule);
+        vector<wasm::Expression*> args = {builder.makeConst(wasm::Literal(int32_t(i)))};
+        func->body = builder.makeSequence(builder.makeCall(enterImport, args, wasm::none),
+                                          instrumenter.countOps(func->body));
+    }
+
+    if (!BinaryenModuleValidate(module))
+    {
+        throw runtime_error("Instrumented wasm module failed validation");
+    }
+    return functionNames;
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <binaryen-c.h>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace wasm
+{
+class Module;
+}
+
+namespace sk
+{
+struct WasmRunResult
+{
+    int32_t returnValue = 0;
+    // Of a run without the counting
+    double seconds = 0;
+    // Wasm instructions executed, counted per straight-line region so early exits from a region
+    // still count the whole region
+    uint64_t instructions = 0;
+    std::map<std::string, uint64_t> calls;
+    // Functions in the order they were first called, the profile used for function ordering
+    std::vector<std::string> firstCalls;
+};
+std::ostream& operator<<(std::ostream& os, const WasmRunResult& result);
+
+/**
+ * WasmRunner
+ *
+ * Runs the exported main of a module in Binaryen's interpreter. The counts come from a copy
+ * instrumented with calls to counting imports, whose puts writes to out. The time comes from a
+ * second run of the module as it is, with its output discarded. The module isn't modified, so it
+ * can be run again.
+ */
+class WasmRunner
+{
+public:
+    WasmRunner(BinaryenModuleRef module, std::ostream& out = std::cout)
+        : m_module(module), m_out(out)
+    {
+    }
+
+    WasmRunResult run();
+
+private:
+    std::vector<std::string> instrument(wasm::Module& wasmModule);
+
+    BinaryenModuleRef m_module;
+    std::ostream& m_out;
+};
+}
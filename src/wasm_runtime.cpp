@@ -0,0 +1,258 @@
+#include "wasm_runtime.hpp"
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+using std::initializer_list;
+using std::string;
+using std::vector;
+
+namespace
+{
+// Blocks of 16 << sizeClass bytes, 16 to 2048
+const int32_t numSizeClasses = 8;
+const int32_t minBlockSize = 16;
+const int32_t maxBlockSize = minBlockSize << (numSizeClasses - 1);
+// Blocks start with their size class, and the next free block while they are free
+const int32_t headerSize = 8;
+const int32_t nextOffset = 4;
+// Too big for a size class, never reused
+const int32_t largeClass = -1;
+const int32_t pageSize = 65536;
+const int32_t pageShift = 16;
+// 1 MiB, memory.grow is expensive enough that it shouldn't show up in profiles
+const int32_t growPages = 16;
+
+const char* const bumpFunction = "sk_heap_bump";
+// Suffix of the allocator functions the locking wrappers call
+const char* const unlockedSuffix = "_unlocked";
+
+/**
+ * Shorthands for building the allocator in Binaryen IR, every value is an i32
+ */
+class IrBuilder
+{
+public:
+    IrBuilder(BinaryenModuleRef module) : m_module(module) {}
+
+    BinaryenExpressionRef constant(int32_t value)
+    {
+        return BinaryenConst(m_module, BinaryenLiteralInt32(value));
+    }
+    BinaryenExpressionRef get(BinaryenIndex local)
+    {
+        return BinaryenLocalGet(m_module, local, BinaryenTypeInt32());
+    }
+    BinaryenExpressionRef set(BinaryenIndex local, BinaryenExpressionRef value)
+    {
+        return BinaryenLocalSet(m_module, local, value);
+    }
+    BinaryenExpressionRef load(BinaryenExpressionRef ptr, uint32_t offset = 0)
+    {
+        return BinaryenLoad(m_module, 4, 0, offset, 4, BinaryenTypeInt32(), ptr);
+    }
+    BinaryenExpressionRef store(BinaryenExpressionRef ptr, BinaryenExpressionRef value,
+                                uint32_t offset = 0)
+    {
+        return BinaryenStore(m_module, 4, offset, 4, ptr, value, BinaryenTypeInt32());
+    }
+    BinaryenExpressionRef binary(BinaryenOp op, BinaryenExpressionRef lhs,
+                                 BinaryenExpressionRef rhs)
+    {
+        return BinaryenBinary(m_module, op, lhs, rhs);
+    }
+    BinaryenExpressionRef call(const char* target, initializer_list<BinaryenExpressionRef> args)
+    {
+        vector<BinaryenExpressionRef> operands(args);
+        return BinaryenCall(m_module, target, operands.data(), operands.size(),
+                            BinaryenTypeInt32());
+    }
+    BinaryenExpressionRef block(initializer_list<BinaryenExpressionRef> children)
+    {
+        vector<BinaryenExpressionRef> list(children);
+        return BinaryenBlock(m_module, nullptr, list.data(), list.size(), BinaryenTypeAuto());
+    }
+    BinaryenExpressionRef ifThen(BinaryenExpressionRef condition, BinaryenExpressionRef ifTrue,
+                                 BinaryenExpressionRef ifFalse = nullptr)
+    {
+        return BinaryenIf(m_module, condition, ifTrue, ifFalse);
+    }
+    BinaryenExpressionRef ret(BinaryenExpressionRef value)
+    {
+        return BinaryenReturn(m_module, value);
+    }
+    BinaryenExpressionRef memorySize()
+    {
+        return BinaryenHost(m_module, BinaryenMemorySize(), nullptr, nullptr, 0);
+    }
+    BinaryenExpressionRef memoryGrow(BinaryenExpressionRef pages)
+    {
+        BinaryenExpressionRef operands[] = {pages};
+        return BinaryenHost(m_module, BinaryenMemoryGrow(), nullptr, operands, 1);
+    }
+    BinaryenExpressionRef unreachable() { return BinaryenUnreachable(m_module); }
+    BinaryenExpressionRef atomicStore(BinaryenExpressionRef ptr, BinaryenExpressionRef value)
+    {
+        return BinaryenAtomicStore(m_module, 4, 0, ptr, value, BinaryenTypeInt32());
+    }
+    BinaryenExpressionRef atomicCmpxchg(BinaryenExpressionRef ptr, BinaryenExpressionRef expected,
+                                        BinaryenExpressionRef replacement)
+    {
+        return BinaryenAtomicCmpxchg(m_module, 4, 0, ptr, expected, replacement,
+                                     BinaryenTypeInt32());
+    }
+    BinaryenExpressionRef loop(const char* name, BinaryenExpressionRef body)
+    {
+        return BinaryenLoop(m_module, name, body);
+    }
+    BinaryenExpressionRef breakIf(const char* name, BinaryenExpressionRef condition)
+    {
+        return BinaryenBreak(m_module, name, condition, nullptr);
+    }
+
+    void addFunction(const char* name, BinaryenIndex numLocals, BinaryenExpressionRef body)
+    {
+        BinaryenType params[] = {BinaryenTypeInt32()};
+        auto type = BinaryenAddFunctionType(m_module, (string(name) + "_type").c_str(),
+                                            BinaryenTypeInt32(), params, 1);
+        vector<BinaryenType> locals(numLocals, BinaryenTypeInt32());
+        BinaryenAddFunction(m_module, name, type, locals.data(), locals.size(), body);
+    }
+
+private:
+    BinaryenModuleRef m_module;
+};
+}
+
+namespace sk
+{
+const char* const wasmAllocFunction = "sk_alloc";
+const char* const wasmFreeFunction = "sk_free";
+const BinaryenIndex wasmHeapMetadataSize = 64;
+
+void addWasmAllocator(BinaryenModuleRef module, BinaryenIndex heapBase, bool threadSafe)
+{
+    IrBuilder b(module);
+    auto allocName = string(wasmAllocFunction) + (threadSafe ? unlockedSuffix : "");
+    auto freeName = string(wasmFreeFunction) + (threadSafe ? unlockedSuffix : "");
+    // Free list heads, then the bump pointer, which is 0 until the first allocation, then the lock
+    auto freeListAddress = [&](BinaryenExpressionRef sizeClass) {
+        return b.binary(BinaryenAddInt32(), b.constant(heapBase),
+                        b.binary(BinaryenShlInt32(), sizeClass, b.constant(2)));
+    };
+    auto heapTopAddress = [&] { return b.constant(heapBase + numSizeClasses * 4); };
+    auto lockAddress = [&] { return b.constant(heapBase + numSizeClasses * 4 + 4); };
+    auto heapStart = static_cast<int32_t>(heapBase + wasmHeapMetadataSize);
+
+    // sk_heap_bump(bytes), locals: block, newTop, memoryEnd, pages
+    {
+        enum { BYTES, BLOCK, NEW_TOP, MEMORY_END, PAGES };
+        auto body = b.block({
+            b.set(BLOCK, b.load(heapTopAddress())),
+            b.ifThen(BinaryenUnary(module, BinaryenEqZInt32(), b.get(BLOCK)),
+                     b.set(BLOCK, b.constant(heapStart))),
+            b.set(NEW_TOP, b.binary(BinaryenAddInt32(), b.get(BLOCK), b.get(BYTES))),
+            b.set(MEMORY_END, b.binary(BinaryenShlInt32(), b.memorySize(), b.constant(pageShift))),
+            b.ifThen(
+                b.binary(BinaryenGtUInt32(), b.get(NEW_TOP), b.get(MEMORY_END)),
+                b.block({
+                    b.set(PAGES,
+                          b.binary(BinaryenShrUInt32(),
+                                   b.binary(BinaryenAddInt32(),
+                                            b.binary(BinaryenSubInt32(), b.get(NEW_TOP),
+                                                     b.get(MEMORY_END)),
+                                            b.constant(pageSize - 1)),
+                                   b.constant(pageShift))),
+                    b.ifThen(b.binary(BinaryenLtUInt32(), b.get(PAGES), b.constant(growPages)),
+                             b.set(PAGES, b.constant(growPages))),
+                    b.ifThen(b.binary(BinaryenEqInt32(), b.memoryGrow(b.get(PAGES)),
+                                      b.constant(-1)),
+                             b.unreachable()),
+                })),
+            b.store(heapTopAddress(), b.get(NEW_TOP)),
+            b.get(BLOCK),
+        });
+        b.addFunction(bumpFunction, 4, body);
+    }
+
+    // sk_alloc(size), locals: sizeClass, block, listAddress
+    {
+        enum { SIZE, SIZE_CLASS, BLOCK, LIST_ADDRESS };
+        auto largeBlock = b.block({
+            b.set(BLOCK,
+                  b.call(bumpFunction,
+                         {b.binary(BinaryenAndInt32(),
+                                   b.binary(BinaryenAddInt32(), b.get(SIZE),
+                                            b.constant(headerSize + minBlockSize - 1)),
+                                   b.constant(-minBlockSize))})),
+            b.store(b.get(BLOCK), b.constant(largeClass)),
+            b.ret(b.binary(BinaryenAddInt32(), b.get(BLOCK), b.constant(headerSize))),
+        });
+        // ceil(log2(size + header)) - log2(minBlockSize), at least 0
+        auto sizeClass = b.binary(
+            BinaryenSubInt32(), b.constant(28),
+            BinaryenUnary(module, BinaryenClzInt32(),
+                          b.binary(BinaryenOrInt32(),
+                                   b.binary(BinaryenAddInt32(), b.get(SIZE),
+                                            b.constant(headerSize - 1)),
+                                   b.constant(minBlockSize - 1))));
+        auto body = b.block({
+            b.ifThen(b.binary(BinaryenGtUInt32(), b.get(SIZE),
+                              b.constant(maxBlockSize - headerSize)),
+                     largeBlock),
+            b.set(SIZE_CLASS, sizeClass),
+            b.set(LIST_ADDRESS, freeListAddress(b.get(SIZE_CLASS))),
+            b.set(BLOCK, b.load(b.get(LIST_ADDRESS))),
+            b.ifThen(b.get(BLOCK),
+                     b.store(b.get(LIST_ADDRESS), b.load(b.get(BLOCK), nextOffset)),
+                     b.block({
+                         b.set(BLOCK, b.call(bumpFunction,
+                                             {b.binary(BinaryenShlInt32(),
+                                                       b.constant(minBlockSize),
+                                                       b.get(SIZE_CLASS))})),
+                         b.store(b.get(BLOCK), b.get(SIZE_CLASS)),
+                     })),
+            b.binary(BinaryenAddInt32(), b.get(BLOCK), b.constant(headerSize)),
+        });
+        b.addFunction(allocName.c_str(), 3, body);
+    }
+
+    // sk_free(ptr), locals: block, listAddress
+    {
+        enum { PTR, BLOCK, LIST_ADDRESS };
+        auto body = b.block({
+            b.ifThen(BinaryenUnary(module, BinaryenEqZInt32(), b.get(PTR)),
+                     b.ret(b.constant(0))),
+            b.set(BLOCK, b.binary(BinaryenSubInt32(), b.get(PTR), b.constant(headerSize))),
+            b.ifThen(b.binary(BinaryenEqInt32(), b.load(b.get(BLOCK)), b.constant(largeClass)),
+                     b.ret(b.constant(0))),
+            b.set(LIST_ADDRESS, freeListAddress(b.load(b.get(BLOCK)))),
+            b.store(b.get(BLOCK), b.load(b.get(LIST_ADDRESS)), nextOffset),
+            b.store(b.get(LIST_ADDRESS), b.get(BLOCK)),
+            b.constant(0),
+        });
+        b.addFunction(freeName.c_str(), 2, body);
+    }
+
+    if (!threadSafe)
+    {
+        return;
+    }
+
+    // sk_alloc(size) and sk_free(ptr) take the lock around the unlocked versions. Browsers don't
+    // allow blocking the main thread with atomic.wait, so waiting is a spin
+    for (auto name : {wasmAllocFunction, wasmFreeFunction})
+    {
+        enum { ARG, RESULT };
+        auto unlockedName = string(name) + unlockedSuffix;
+        auto body = b.block({
+            b.loop("acquire", b.breakIf("acquire", b.atomicCmpxchg(lockAddress(), b.constant(0),
+                                                                   b.constant(1)))),
+            b.set(RESULT, b.call(unlockedName.c_str(), {b.get(ARG)})),
+            b.atomicStore(lockAddress(), b.constant(0)),
+            b.get(RESULT),
+        });
+        b.addFunction(name, 1, body);
+    }
+}
+}
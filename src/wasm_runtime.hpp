@@ -0,0 +1,25 @@
+#pragma once
+#include <binaryen-c.h>
+
+namespace sk
+{
+/**
+ * Allocator runtime for the wasm target, callable from Skiff as sk_alloc(size) and sk_free(ptr)
+ */
+extern const char* const wasmAllocFunction;
+extern const char* const wasmFreeFunction;
+
+/**
+ * Bytes of linear memory from heapBase used by the allocator's own state, blocks come after
+ */
+extern const BinaryenIndex wasmHeapMetadataSize;
+
+/**
+ * Adds the allocator functions to a module. Small blocks come from power of two size class free
+ * lists, and refill from a bump pointer that grows memory many pages at a time. heapBase must be
+ * 16 byte aligned, everything from it up belongs to the allocator, and the module needs a
+ * memory. With threadSafe, every call holds a spinlock in linear memory, which needs the atomics
+ * feature.
+ */
+void addWasmAllocator(BinaryenModuleRef module, BinaryenIndex heapBase, bool threadSafe = false);
+}
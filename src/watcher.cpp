@@ -0,0 +1,141 @@
+#include "watcher.hpp"
+#include "util/logger.hpp"
+#include <stdexcept>
+#include <utility>
+
+using std::endl;
+using std::ostream;
+using std::vector;
+
+namespace
+{
+// Editors often save with several writes or a write and a rename
+constexpr uint64_t debounceMs = 30;
+
+double toMs(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+}
+
+namespace sk
+{
+Watcher::Watcher(const vector<const char*>& filenames, BuildFunction build, ostream& out)
+    : m_build(std::move(build)), m_out(out)
+{
+    uv_loop_init(&m_loop);
+    uv_timer_init(&m_loop, &m_debounce);
+    m_debounce.data = this;
+    uv_signal_init(&m_loop, &m_sigint);
+    m_sigint.data = this;
+    for (auto filename : filenames)
+    {
+        std::unique_ptr<WatchedFile> file(new WatchedFile());
+        file->filename = filename;
+        file->watcher = this;
+        file->dirty = false;
+        uv_fs_event_init(&m_loop, &file->event);
+        file->event.data = file.get();
+        m_files.push_back(std::move(file));
+    }
+}
+
+Watcher::~Watcher()
+{
+    uv_walk(&m_loop,
+            [](uv_handle_t* handle, void*) {
+                if (!uv_is_closing(handle))
+                {
+                    uv_close(handle, nullptr);
+                }
+            },
+            nullptr);
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+    uv_loop_close(&m_loop);
+}
+
+void Watcher::run()
+{
+    for (auto& file : m_files)
+    {
+        file->changedAt = Clock::now();
+        rebuild(*file);
+        startWatching(*file);
+    }
+    m_out << "Watching " << m_files.size() << " files" << endl;
+    uv_signal_start(&m_sigint, onSignal, SIGINT);
+    uv_run(&m_loop, UV_RUN_DEFAULT);
+}
+
+void Watcher::onChange(uv_fs_event_t* event, const char*, int, int status)
+{
+    auto& file = *static_cast<WatchedFile*>(event->data);
+    if (status < 0)
+    {
+        loge << "Watching " << file.filename << " failed: " << uv_strerror(status);
+        return;
+    }
+    if (!file.dirty)
+    {
+        file.dirty = true;
+        file.changedAt = Clock::now();
+    }
+    uv_timer_start(&file.watcher->m_debounce, onDebounce, debounceMs, 0);
+}
+
+void Watcher::onDebounce(uv_timer_t* timer)
+{
+    auto watcher = static_cast<Watcher*>(timer->data);
+    for (auto& file : watcher->m_files)
+    {
+        if (file->dirty)
+        {
+            // A save that renames a new file over the old one leaves the watch on the old inode
+            watcher->startWatching(*file);
+            watcher->rebuild(*file);
+        }
+    }
+}
+
+void Watcher::onSignal(uv_signal_t* signal, int)
+{
+    uv_stop(signal->loop);
+}
+
+void Watcher::startWatching(WatchedFile& file)
+{
+    uv_fs_event_stop(&file.event);
+    if (auto error = uv_fs_event_start(&file.event, onChange, file.filename, 0))
+    {
+        logw << "Cannot watch " << file.filename << ": " << uv_strerror(error);
+    }
+}
+
+void Watcher::rebuild(WatchedFile& file)
+{
+    file.dirty = false;
+    try
+    {
+        auto source = SourceBuffer::readFile(file.filename);
+        if (file.frontend && source == file.frontend->getSource())
+        {
+            logi << file.filename << " is unchanged";
+            return;
+        }
+
+        auto buildStart = Clock::now();
+        std::unique_ptr<Frontend> frontend(new Frontend(file.filename, std::move(source)));
+        frontend->parse();
+        m_build(*frontend);
+        file.frontend = std::move(frontend);
+
+        auto end = Clock::now();
+        m_out << "Rebuilt " << file.filename << " in " << toMs(end - buildStart) << " ms, "
+              << toMs(end - file.changedAt) << " ms after the edit" << endl;
+    }
+    catch (const std::exception& e)
+    {
+        m_out << file.filename << ": " << e.what() << endl;
+    }
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "frontend.hpp"
+#include <uv.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace sk
+{
+/**
+ * Watcher
+ *
+ * Watches source files with libuv filesystem events and rebuilds the ones that changed. A file is
+ * only parsed and built again when its contents differ from the SourceBuffer of the last build,
+ * and a failed build keeps the last good Frontend. Every rebuild reports the time from the first
+ * change event to the artifact being written
+ */
+class Watcher
+{
+public:
+    using BuildFunction = std::function<void(Frontend& frontend)>;
+
+    Watcher(const std::vector<const char*>& filenames, BuildFunction build, std::ostream& out);
+    ~Watcher();
+
+    /**
+     * Builds every file, then rebuilds them as they change until SIGINT
+     */
+    void run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct WatchedFile
+    {
+        const char* filename;
+        uv_fs_event_t event;
+        Watcher* watcher;
+        bool dirty;
+        Clock::time_point changedAt;
+        std::unique_ptr<Frontend> frontend;
+    };
+
+    static void onChange(uv_fs_event_t* event, const char* filename, int events, int status);
+    static void onDebounce(uv_timer_t* timer);
+    static void onSignal(uv_signal_t* signal, int signum);
+    void startWatching(WatchedFile& file);
+    void rebuild(WatchedFile& file);
+
+    const BuildFunction m_build;
+    std::ostream& m_out;
+    uv_loop_t m_loop;
+    uv_timer_t m_debounce;
+    uv_signal_t m_sigint;
+    std::vector<std::unique_ptr<WatchedFile>> m_files;
+};
+}
@@ -0,0 +1,195 @@
+#include "ast.hpp"
+#include "code_gen.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include <gtest/gtest.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <string>
+
+using sk::CodeGen;
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::SourceBuffer;
+
+class CodeGenFixture : public ::testing::Test
+{
+public:
+    CodeGenFixture(bool instrument = false)
+        : lexer(buffer), module("codeGenTest"), parser(module, lexer),
+          codeGen("codeGenTest", llvmContext, instrument)
+    {
+    }
+
+protected:
+    /**
+     * Generates source, checks the module with the LLVM verifier and returns functionName
+     */
+    llvm::Function& generate(const char* source, const char* functionName)
+    {
+        buffer.addBlock(source);
+        parser.parse();
+        codeGen.dispatch(module);
+        std::string errors;
+        llvm::raw_string_ostream errorStream(errors);
+        EXPECT_FALSE(llvm::verifyModule(codeGen.getLlvmModule(), &errorStream))
+            << errorStream.str();
+        auto function = codeGen.getLlvmModule().getFunction(functionName);
+        EXPECT_NE(nullptr, function);
+        return *function;
+    }
+
+    static bool calls(const llvm::Instruction& instruction, const char* callee)
+    {
+        auto call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+        return call && call->getCalledFunction() &&
+               call->getCalledFunction()->getName() == callee;
+    }
+
+    SourceBuffer buffer;
+    Lexer lexer;
+    Module module;
+    Parser parser;
+    llvm::LLVMContext llvmContext;
+    CodeGen codeGen;
+};
+
+class InstrumentFixture : public CodeGenFixture
+{
+public:
+    InstrumentFixture() : CodeGenFixture(true) {}
+};
+
+TEST_F(CodeGenFixture, privateFunctionsAreInternalAndFast)
+{
+    auto& function = generate("fn twice(x) { x * 2 }\nfn api*(x) { twice(x) + 1 }", "twice");
+    EXPECT_EQ(llvm::GlobalValue::InternalLinkage, function.getLinkage());
+    EXPECT_EQ(llvm::CallingConv::Fast, function.getCallingConv());
+
+    auto& api = *codeGen.getLlvmModule().getFunction("api");
+    EXPECT_EQ(llvm::GlobalValue::ExternalLinkage, api.getLinkage());
+    EXPECT_EQ(llvm::CallingConv::C, api.getCallingConv());
+}
+
+TEST_F(CodeGenFixture, callsBeforeDefinitionArePatched)
+{
+    // later is only a declaration when api calls it
+    auto& function = generate("fn api*(x) { later(x) + 1 }\nfn later(x) { x * 2 }", "later");
+    EXPECT_EQ(llvm::GlobalValue::InternalLinkage, function.getLinkage());
+    EXPECT_EQ(llvm::CallingConv::Fast, function.getCallingConv());
+    ASSERT_FALSE(function.user_empty());
+    for (auto user : function.users())
+    {
+        auto call = llvm::dyn_cast<llvm::CallInst>(user);
+        ASSERT_NE(nullptr, call);
+        EXPECT_EQ(llvm::CallingConv::Fast, call->getCallingConv());
+    }
+}
+
+TEST_F(CodeGenFixture, pureFunctionGetsEffectAttributes)
+{
+    auto& function = generate("fn square(x) { x * x }", "square");
+    EXPECT_TRUE(function.doesNotAccessMemory());
+    EXPECT_TRUE(function.doesNotThrow());
+#if LLVM_VERSION_MAJOR >= 12
+    EXPECT_TRUE(function.willReturn());
+#endif
+}
+
+TEST_F(CodeGenFixture, putsCallerKeepsItsEffects)
+{
+    auto& function = generate("fn greet(x) { puts(\"hi\") }", "greet");
+    EXPECT_FALSE(function.doesNotAccessMemory());
+    EXPECT_FALSE(function.onlyReadsMemory());
+    EXPECT_TRUE(function.doesNotThrow());
+}
+
+TEST_F(CodeGenFixture, recursiveFunctionMayNotReturn)
+{
+    auto& function = generate("fn even(n) { if n { odd(n - 1) } else { 1 } }\n"
+                              "fn odd(n) { if n { even(n - 1) } else { 0 } }",
+                              "even");
+    EXPECT_TRUE(function.doesNotAccessMemory());
+#if LLVM_VERSION_MAJOR >= 12
+    EXPECT_FALSE(function.willReturn());
+#endif
+}
+
+TEST_F(InstrumentFixture, entersFirstAndExitsBeforeEveryReturn)
+{
+    auto& function = generate("fn pick(x) { if x { x * 2 } else { other(x) } }", "pick");
+    EXPECT_TRUE(calls(function.getEntryBlock().front(), "__sk_prof_enter"));
+    auto numReturns = 0;
+    for (auto& block : function)
+    {
+        if (llvm::isa<llvm::ReturnInst>(block.getTerminator()))
+        {
+            ++numReturns;
+            EXPECT_TRUE(calls(*block.getTerminator()->getPrevNode(), "__sk_prof_exit"));
+        }
+    }
+    // The call to other is in tail position and returns on its own
+    EXPECT_EQ(2, numReturns);
+}
+
+TEST_F(InstrumentFixture, keepsFramesAndEffects)
+{
+    auto& function = generate("fn twice(x) { x * 2 }\nfn loop(x) { twice(x) }", "loop");
+    for (auto& block : function)
+    {
+        for (auto& instruction : block)
+        {
+            if (auto call = llvm::dyn_cast<llvm::CallInst>(&instruction))
+            {
+                EXPECT_FALSE(call->isTailCall());
+            }
+        }
+    }
+    // A pure function calling the runtime would let LLVM drop the calls
+    EXPECT_FALSE(codeGen.getLlvmModule().getFunction("twice")->doesNotAccessMemory());
+}
+
+TEST_F(CodeGenFixture, tailCallToLaterDefinitionIsValid)
+{
+    // b is a C declaration when the call is generated and fastcc once it is defined, the
+    // exported caller stays C, so the call can't be musttail
+    auto& function = generate("fn a*(x) { b(x) }\nfn b(x) { x + 1 }", "a");
+    auto& call = llvm::cast<llvm::CallInst>(*function.getEntryBlock().getFirstNonPHI());
+    EXPECT_TRUE(call.isTailCall());
+    EXPECT_FALSE(call.isMustTailCall());
+}
+
+TEST_F(CodeGenFixture, tailCallWithOtherPrototypeIsValid)
+{
+    // puts takes an i8*, hello an i32
+    auto& function = generate("fn hello*(x) { puts(\"hi\") }", "hello");
+    for (auto& instruction : function.getEntryBlock())
+    {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&instruction))
+        {
+            EXPECT_FALSE(call->isMustTailCall());
+        }
+    }
+}
+
+TEST_F(CodeGenFixture, tailCallWithSamePrototypeIsMustTail)
+{
+    auto& function = generate("fn a(x) { x + 1 }\nfn b(x) { a(x) }", "b");
+    auto& call = llvm::cast<llvm::CallInst>(*function.getEntryBlock().getFirstNonPHI());
+    EXPECT_TRUE(call.isMustTailCall());
+}
+
+TEST_F(CodeGenFixture, selfTailCallBecomesLoop)
+{
+    auto& function = generate("fn count(n) { if n { count(n - 1) } else { 0 } }", "count");
+    EXPECT_TRUE(function.user_empty());
+    auto& header = *function.getEntryBlock().getSingleSuccessor();
+    EXPECT_TRUE(llvm::isa<llvm::PHINode>(header.front()));
+}
@@ -0,0 +1,77 @@
+#include "ast.hpp"
+#include "effect_analysis.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include <gtest/gtest.h>
+
+using sk::Effect;
+using sk::EffectAnalysis;
+using sk::Function;
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::SourceBuffer;
+
+class EffectAnalysisFixture : public ::testing::Test
+{
+public:
+    EffectAnalysisFixture() : lexer(buffer), module("effectTest"), parser(module, lexer) {}
+
+protected:
+    void analyze(const char* source)
+    {
+        buffer.addBlock(source);
+        parser.parse();
+        analysis.dispatch(module);
+    }
+
+    Function& function(size_t i)
+    {
+        return dynamic_cast<Function&>(module.getMainBlock().getExpressions()[i].get());
+    }
+
+    SourceBuffer buffer;
+    Lexer lexer;
+    Module module;
+    Parser parser;
+    EffectAnalysis analysis;
+};
+
+TEST_F(EffectAnalysisFixture, arithmeticIsPure)
+{
+    analyze("fn square(x) { x * x }");
+    EXPECT_EQ(Effect::PURE, analysis.getEffect(function(0)));
+    EXPECT_TRUE(analysis.isNoUnwind(function(0)));
+    EXPECT_TRUE(analysis.willReturn(function(0)));
+}
+
+TEST_F(EffectAnalysisFixture, putsHasSideEffect)
+{
+    analyze("fn greet(x) { puts(\"hi\") } fn twice(x) { greet(x) greet(x) }");
+    EXPECT_EQ(Effect::SIDE_EFFECT, analysis.getEffect(function(0)));
+    EXPECT_EQ(Effect::SIDE_EFFECT, analysis.getEffect(function(1)));
+    EXPECT_TRUE(analysis.isNoUnwind(function(1)));
+}
+
+TEST_F(EffectAnalysisFixture, unknownCallHasSideEffect)
+{
+    analyze("fn wrap(x) { external(x) }");
+    EXPECT_EQ(Effect::SIDE_EFFECT, analysis.getEffect(function(0)));
+    EXPECT_FALSE(analysis.isNoUnwind(function(0)));
+    EXPECT_FALSE(analysis.willReturn(function(0)));
+}
+
+TEST_F(EffectAnalysisFixture, recursionIsPureButMayNotReturn)
+{
+    analyze("fn even(n) { if n { odd(n - 1) } else { 1 } } "
+            "fn odd(n) { if n { even(n - 1) } else { 0 } } "
+            "fn parity(n) { odd(n) } "
+            "fn leaf(n) { n + 1 }");
+    for (auto i = 0u; i < 3; ++i)
+    {
+        EXPECT_EQ(Effect::PURE, analysis.getEffect(function(i)));
+        EXPECT_FALSE(analysis.willReturn(function(i)));
+    }
+    EXPECT_TRUE(analysis.willReturn(function(3)));
+}
@@ -0,0 +1,240 @@
+#include "compiler.hpp"
+#include "frontend.hpp"
+#include "llvm_backend.hpp"
+#include "wasm_code_gen.hpp"
+#include <binaryen-c.h>
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Error.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using sk::Compiler;
+using sk::CompilerOptions;
+using sk::Frontend;
+using sk::WasmCodeGen;
+using std::map;
+using std::string;
+
+namespace
+{
+const char* const budgetsPath = SKIFF_SOURCE_DIR "/test/ir_budgets.txt";
+// Examples are named by their path from here, without the .sk
+const char* const sourceDir = SKIFF_SOURCE_DIR "/";
+// Set to rewrite the budgets with what the examples measure now
+const char* const updateVariable = "SKIFF_UPDATE_IR_BUDGETS";
+// Every .sk in these is held to budgets, unless the budgets file skips it
+const char* const exampleDirs[] = {"examples", "bench/runtime"};
+// Printed but not budgeted. text_bytes moves with the LLVM version as much as with our codegen,
+// and the wasm bytes have no recorded budgets yet
+const std::set<string> reportedMetrics = {"text_bytes", "bytes"};
+
+// Metric name to value, for one example built one way
+using Metrics = map<string, size_t>;
+
+size_t getTextBytes(const std::vector<char>& object)
+{
+    llvm::MemoryBufferRef buffer(llvm::StringRef(object.data(), object.size()), "object");
+    auto objectFile = llvm::object::ObjectFile::createObjectFile(buffer);
+    if (!objectFile)
+    {
+        llvm::consumeError(objectFile.takeError());
+        throw std::runtime_error("Could not read the emitted object");
+    }
+    size_t bytes = 0;
+    for (auto& section : (*objectFile)->sections())
+    {
+        if (section.isText())
+        {
+            bytes += section.getSize();
+        }
+    }
+    return bytes;
+}
+
+Metrics measureLlvm(const string& example, int optLevel)
+{
+    auto path = sourceDir + example + ".sk";
+    llvm::LLVMContext llvmContext;
+    CompilerOptions options;
+    options.optLevel = optLevel;
+    Compiler compiler(path.c_str(), llvmContext, options);
+    compiler.compile();
+    auto module = compiler.takeLlvmModule();
+
+    Metrics metrics{{"instructions", 0}, {"blocks", 0}, {"allocas", 0}, {"calls", 0}};
+    for (auto& function : *module)
+    {
+        metrics["blocks"] += function.size();
+        for (auto& block : function)
+        {
+            for (auto& instruction : block)
+            {
+                ++metrics["instructions"];
+                metrics["allocas"] += llvm::isa<llvm::AllocaInst>(instruction);
+                metrics["calls"] += llvm::isa<llvm::CallInst>(instruction);
+            }
+        }
+    }
+    metrics["text_bytes"] = getTextBytes(sk::emitObject(*module, optLevel));
+    return metrics;
+}
+
+Metrics measureWasm(const string& example)
+{
+    auto path = sourceDir + example + ".sk";
+    Frontend frontend(path.c_str());
+    frontend.parse();
+    WasmCodeGen codeGen;
+    codeGen.dispatch(frontend.getModule());
+    auto result = BinaryenModuleAllocateAndWrite(codeGen.getBinaryenModule(), nullptr);
+    std::free(result.binary);
+    return {{"bytes", result.binaryBytes}};
+}
+
+std::set<string> findExamples()
+{
+    std::set<string> examples;
+    for (auto dir : exampleDirs)
+    {
+        auto path = sourceDir + string(dir);
+        std::unique_ptr<DIR, decltype(&closedir)> entries(opendir(path.c_str()), &closedir);
+        if (!entries)
+        {
+            throw std::runtime_error(string("Could not list ") + dir);
+        }
+        while (auto entry = readdir(entries.get()))
+        {
+            string name = entry->d_name;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".sk") == 0)
+            {
+                examples.insert(string(dir) + "/" + name.substr(0, name.size() - 3));
+            }
+        }
+    }
+    return examples;
+}
+
+/**
+ * Lines of "example build metric budget" or "skip example reason", # starts a comment
+ */
+map<string, size_t> readBudgets(map<string, string>& skipped)
+{
+    std::ifstream in(budgetsPath);
+    if (!in)
+    {
+        throw std::runtime_error(string("Could not read ") + budgetsPath);
+    }
+    map<string, size_t> budgets;
+    string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        string example, build, metric;
+        size_t budget;
+        if (line.compare(0, 5, "skip ") == 0 && fields >> build >> example)
+        {
+            std::getline(fields >> std::ws, skipped[example]);
+            continue;
+        }
+        if (!(fields >> example >> build >> metric >> budget))
+        {
+            throw std::runtime_error("Malformed budget: " + line);
+        }
+        budgets[example + " " + build + " " + metric] = budget;
+    }
+    return budgets;
+}
+
+void writeBudgets(const map<string, Metrics>& measured, const map<string, string>& skipped)
+{
+    std::ofstream out(budgetsPath);
+    out << "# Budgets for test_ir_quality: example, build, metric and the most it may measure.\n"
+           "# Rewrite with " << updateVariable << "=1 after a deliberate codegen change and\n"
+           "# review the diff like code. Examples that can't be built are skipped with a reason\n";
+    for (auto& skip : skipped)
+    {
+        out << "skip " << skip.first << " " << skip.second << "\n";
+    }
+    for (auto& build : measured)
+    {
+        for (auto& metric : build.second)
+        {
+            if (!reportedMetrics.count(metric.first))
+            {
+                out << build.first << " " << metric.first << " " << metric.second << "\n";
+            }
+        }
+    }
+}
+}
+
+TEST(IrQuality, examplesStayWithinBudgets)
+{
+    map<string, string> skipped;
+    auto budgets = readBudgets(skipped);
+    std::set<string> examples;
+    for (auto& example : findExamples())
+    {
+        if (!skipped.count(example))
+        {
+            examples.insert(example);
+        }
+    }
+    ASSERT_FALSE(examples.empty());
+
+    // Keyed by "example build"
+    map<string, Metrics> measured;
+    for (auto& example : examples)
+    {
+        measured[example + " O0"] = measureLlvm(example, 0);
+        measured[example + " O2"] = measureLlvm(example, 2);
+        measured[example + " wasm"] = measureWasm(example);
+    }
+
+    if (std::getenv(updateVariable))
+    {
+        writeBudgets(measured, skipped);
+        return;
+    }
+    for (auto& build : measured)
+    {
+        for (auto& metric : build.second)
+        {
+            auto key = build.first + " " + metric.first;
+            if (reportedMetrics.count(metric.first))
+            {
+                std::cout << key << " measured " << metric.second << std::endl;
+                continue;
+            }
+            auto budget = budgets.find(key);
+            if (budget == budgets.end())
+            {
+                ADD_FAILURE() << "No budget for " << key << ", measured " << metric.second
+                              << ". Record it with " << updateVariable << "=1";
+                continue;
+            }
+            EXPECT_LE(metric.second, budget->second) << key << " is over budget";
+            if (metric.second < budget->second)
+            {
+                std::cout << key << " is " << budget->second - metric.second
+                          << " under budget, tighten it" << std::endl;
+            }
+        }
+    }
+}
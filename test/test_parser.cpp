@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 #include <string>
 
+using sk::Function;
 using sk::Token;
 using sk::Lexer;
 using sk::I32Literal;
@@ -68,6 +69,18 @@ TEST_F(ParserFixture, parsesUnaryOperator)
     EXPECT_EQ("++", op.getName());
 }
 
+TEST_F(ParserFixture, parsesTopLevelExpressionsOneAtATime)
+{
+    buffer.addBlock("fn foo(x) { x } foo(3) 7");
+    parser.begin();
+    auto first = parser.parseTopLevelExpr();
+    EXPECT_NE(nullptr, dynamic_cast<Function*>(first));
+    EXPECT_NE(nullptr, parser.parseTopLevelExpr());
+    EXPECT_NE(nullptr, parser.parseTopLevelExpr());
+    EXPECT_EQ(nullptr, parser.parseTopLevelExpr());
+    EXPECT_EQ(3, module.getMainBlock().getExpressions().size());
+}
+
 TEST_F(ParserFixture, parsesPlusTimes)
 {
     buffer.addBlock("23 + 7 * 32");
@@ -80,6 +93,18 @@ TEST_F(ParserFixture, parsesFunction)
     parser.parse();
 }
 
+TEST_F(ParserFixture, parsesExportedFunction)
+{
+    buffer.addBlock("fn hidden(x) { x } fn shown*(x) { x }");
+    parser.parse();
+    auto& expressions = module.getMainBlock().getExpressions();
+    EXPECT_EQ(2, expressions.size());
+    EXPECT_FALSE(dynamic_cast<Function&>(expressions[0].get()).isExported());
+    auto& exported = dynamic_cast<Function&>(expressions[1].get());
+    EXPECT_TRUE(exported.isExported());
+    EXPECT_EQ("shown", exported.getName());
+}
+
 TEST_F(ParserFixture, parsesUnaryFunction)
 {
     buffer.addBlock("fn ident(x) { x }");
@@ -0,0 +1,92 @@
+#include "ast.hpp"
+#include "code_gen.hpp"
+#include "lexer.hpp"
+#include "llvm_backend.hpp"
+#include "parser.hpp"
+#include "perf_jit_listener.hpp"
+#include "source.hpp"
+#include <gtest/gtest.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+
+using sk::CodeGen;
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::PerfJitListener;
+using sk::SourceBuffer;
+
+namespace
+{
+/**
+ * The perf map lines by function name, perf reads them as "<start> <size> <name>" in hex
+ */
+std::map<std::string, std::string> readPerfMap()
+{
+    std::ifstream in("/tmp/perf-" + std::to_string(getpid()) + ".map");
+    std::map<std::string, std::string> lines;
+    for (std::string line; std::getline(in, line);)
+    {
+        auto nameStart = line.find(' ', line.find(' ') + 1) + 1;
+        lines[line.substr(nameStart)] = line;
+    }
+    return lines;
+}
+}
+
+TEST(PerfJitListenerTest, writesPerfMapLineForEveryFunction)
+{
+    sk::initLlvmTargets();
+    SourceBuffer buffer;
+    Lexer lexer(buffer);
+    Module module("perfTest");
+    Parser parser(module, lexer);
+    buffer.addBlock("fn answer*(x) { x + 41 }\nanswer(1)");
+    parser.parse();
+    llvm::LLVMContext llvmContext;
+    CodeGen codeGen("perfTest", llvmContext);
+    codeGen.dispatch(module);
+
+    {
+        // Outlives the engine, which notifies it as it frees the code
+        PerfJitListener listener;
+        std::string error;
+        std::unique_ptr<llvm::ExecutionEngine> engine(
+            llvm::EngineBuilder(codeGen.takeLlvmModule())
+                .setEngineKind(llvm::EngineKind::JIT)
+                .setErrorStr(&error)
+                .setMCJITMemoryManager(std::unique_ptr<llvm::RTDyldMemoryManager>(
+                    new llvm::SectionMemoryManager()))
+                .create());
+        ASSERT_NE(nullptr, engine) << error;
+        engine->RegisterJITEventListener(&listener);
+        engine->finalizeObject();
+
+        auto lines = readPerfMap();
+        ASSERT_EQ(1u, lines.count("answer"));
+        unsigned long start = 0;
+        unsigned long size = 0;
+        char name[16] = {};
+        ASSERT_EQ(3, sscanf(lines["answer"].c_str(), "%lx %lx %15s", &start, &size, name));
+        EXPECT_EQ(engine->getFunctionAddress("answer"), start);
+        EXPECT_GT(size, 0u);
+        EXPECT_STREQ("answer", name);
+
+        // Only the top level code is renamed
+        ASSERT_EQ(1u, lines.count("main (top level)"));
+        ASSERT_EQ(2, sscanf(lines["main (top level)"].c_str(), "%lx %lx", &start, &size));
+        EXPECT_EQ(engine->getFunctionAddress("main"), start);
+    }
+    auto pid = std::to_string(getpid());
+    std::remove(("/tmp/perf-" + pid + ".map").c_str());
+    std::remove(("/tmp/jit-" + pid + ".dump").c_str());
+}
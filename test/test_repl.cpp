@@ -0,0 +1,53 @@
+#include "repl.hpp"
+#include "util/logger.hpp"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using sk::Repl;
+
+class ReplFixture : public ::testing::Test
+{
+public:
+    ReplFixture() : repl(out, codeOut) {}
+
+protected:
+    std::ostringstream out;
+    std::ostringstream codeOut;
+    Repl repl;
+};
+
+TEST_F(ReplFixture, earlierLinesDontRunAgain)
+{
+    // Log lines go to stdout too
+    sk::setLogSeverity(sk::LogSeverity::WARN);
+    testing::internal::CaptureStdout();
+    repl.addLine("puts(\"once\")");
+    repl.addLine("1 + 2");
+    repl.addLine("3 * 4");
+    fflush(stdout);
+    auto printed = testing::internal::GetCapturedStdout();
+    sk::setLogSeverity(sk::LogSeverity::DEBUG);
+
+    EXPECT_EQ("once\n", printed);
+}
+
+TEST_F(ReplFixture, letsAndFunctionsCarryOverToLaterLines)
+{
+    repl.addLine("let a = 2");
+    repl.addLine("fn twice(x) { x * 2 }");
+    repl.addLine("twice(a) + 1");
+    repl.addLine("let a = a * 10");
+    repl.addLine("twice(a)");
+    EXPECT_EQ("a = 2\n5\na = 20\n40\n", out.str());
+}
+
+TEST_F(ReplFixture, badLinesLeaveTheSessionUsable)
+{
+    EXPECT_THROW(repl.addLine("foo(1)"), std::runtime_error);
+    EXPECT_THROW(repl.addLine("fn twice(x) { double(x) }"), std::runtime_error);
+    repl.addLine("1 + 2");
+    EXPECT_EQ("3\n", out.str());
+}
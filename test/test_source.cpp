@@ -49,6 +49,20 @@ TEST(SourceBuffer, iterates)
     EXPECT_TRUE(equal(buffer.cbegin(), buffer.cend(), s.cbegin()));
 }
 
+TEST(SourceBuffer, comparesContentsAcrossBlocks)
+{
+    SourceBuffer split;
+    split.addBlock(string("foo"));
+    split.addBlock(string("bar"));
+    SourceBuffer whole;
+    whole.addBlock(string("foobar"));
+    EXPECT_TRUE(split == whole);
+
+    SourceBuffer other;
+    other.addBlock(string("foobaz"));
+    EXPECT_TRUE(split != other);
+}
+
 TEST(SourceBuffer, getChar)
 {
     SourceBuffer buffer;
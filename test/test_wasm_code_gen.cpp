@@ -0,0 +1,107 @@
+#include "ast.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "wasm_code_gen.hpp"
+#include "wasm_runner.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::SourceBuffer;
+using sk::WasmCodeGen;
+using sk::WasmRunner;
+
+class WasmCodeGenFixture : public ::testing::Test
+{
+public:
+    WasmCodeGenFixture() : lexer(buffer), module("wasmTest"), parser(module, lexer) {}
+
+protected:
+    void generate(const char* source)
+    {
+        buffer.addBlock(source);
+        parser.parse();
+        codeGen.dispatch(module);
+    }
+
+    SourceBuffer buffer;
+    Lexer lexer;
+    Module module;
+    Parser parser;
+    WasmCodeGen codeGen;
+};
+
+TEST_F(WasmCodeGenFixture, generatesMain)
+{
+    generate("fn square(x) { x * x } let y = square(7) if y - 49 { 1 } else { y / 7 }");
+    EXPECT_NE(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "main"));
+    EXPECT_NE(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "square"));
+}
+
+TEST_F(WasmCodeGenFixture, libraryHasNoMain)
+{
+    generate("fn sumTo*(n, acc) { if n { sumTo(n - 1, acc + n) } else { acc } }");
+    EXPECT_EQ(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "main"));
+    EXPECT_NE(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "sumTo"));
+}
+
+TEST_F(WasmCodeGenFixture, importsUndefinedFunctions)
+{
+    generate("puts(\"hello\") external(1, 2)");
+    EXPECT_NE(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "puts"));
+    EXPECT_NE(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "external"));
+}
+
+TEST_F(WasmCodeGenFixture, rejectsArityMismatch)
+{
+    EXPECT_THROW(generate("fn f(x) { x } f(1, 2)"), std::runtime_error);
+}
+
+TEST_F(WasmCodeGenFixture, runPrintsOnce)
+{
+    generate("puts(\"hello\") 7");
+    std::ostringstream out;
+    auto result = WasmRunner(codeGen.getBinaryenModule(), out).run();
+    EXPECT_EQ(7, result.returnValue);
+    EXPECT_EQ("hello\n", out.str());
+}
+
+TEST_F(WasmCodeGenFixture, runLeavesModuleUnchanged)
+{
+    generate("fn square(x) { x * x } square(6)");
+    auto first = WasmRunner(codeGen.getBinaryenModule()).run();
+    auto second = WasmRunner(codeGen.getBinaryenModule()).run();
+    EXPECT_EQ(36, second.returnValue);
+    EXPECT_EQ(first.instructions, second.instructions);
+    EXPECT_EQ(nullptr, BinaryenGetFunction(codeGen.getBinaryenModule(), "skiff_ops"));
+}
+
+TEST_F(WasmCodeGenFixture, allocatorReusesFreedBlocks)
+{
+    generate("let a = sk_alloc(24) sk_free(a) let b = sk_alloc(20) b - a");
+    EXPECT_EQ(0, WasmRunner(codeGen.getBinaryenModule()).run().returnValue);
+}
+
+TEST_F(WasmCodeGenFixture, allocatorSeparatesLiveBlocks)
+{
+    generate("let a = sk_alloc(24) let b = sk_alloc(24) b - a");
+    EXPECT_EQ(32, WasmRunner(codeGen.getBinaryenModule()).run().returnValue);
+}
+
+TEST_F(WasmCodeGenFixture, allocatorGrowsMemory)
+{
+    generate("let a = sk_alloc(100000) let b = sk_alloc(3000000) let c = sk_alloc(8) c - b");
+    EXPECT_EQ(3000016, WasmRunner(codeGen.getBinaryenModule()).run().returnValue);
+}
+
+TEST_F(WasmCodeGenFixture, lowersAtomics)
+{
+    codeGen.enableThreads();
+    generate("let p = sk_alloc(8) atomic_store(p, 40) atomic_add(p, 2) "
+             "atomic_cas(p, 42, 7) + atomic_load(p)");
+    EXPECT_EQ(49, WasmRunner(codeGen.getBinaryenModule()).run().returnValue);
+}
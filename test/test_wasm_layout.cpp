@@ -0,0 +1,142 @@
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "wasm_code_gen.hpp"
+#include "wasm_layout.hpp"
+#include <gtest/gtest.h>
+#include <shell-interface.h>
+#include <wasm-interpreter.h>
+#include <wasm.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using sk::Lexer;
+using sk::Module;
+using sk::Parser;
+using sk::SourceBuffer;
+using sk::WasmCodeGen;
+using std::string;
+using std::vector;
+
+namespace
+{
+/**
+ * Host for a split module. Both instances share the primary's memory and table, and calls through
+ * the table run in the cold instance once it is loaded, where the table's functions live
+ */
+class SplitInterface : public wasm::ShellExternalInterface
+{
+public:
+    void init(wasm::Module& wasm, wasm::ModuleInstance& instance) override
+    {
+        if (!m_initialized)
+        {
+            ShellExternalInterface::init(wasm, instance);
+            m_initialized = true;
+        }
+    }
+
+    wasm::Literal callImport(wasm::Function* import, wasm::LiteralList& arguments) override
+    {
+        if (import->module == "skiff_hot")
+        {
+            return hot->callExport(import->base, arguments);
+        }
+        return ShellExternalInterface::callImport(import, arguments);
+    }
+
+    wasm::Literal callTable(wasm::Index index, wasm::LiteralList& arguments, wasm::Type result,
+                            wasm::ModuleInstance& instance) override
+    {
+        return ShellExternalInterface::callTable(index, arguments, result, cold ? *cold : instance);
+    }
+
+    wasm::ModuleInstance* hot = nullptr;
+    wasm::ModuleInstance* cold = nullptr;
+
+private:
+    bool m_initialized = false;
+};
+}
+
+class WasmLayoutFixture : public ::testing::Test
+{
+public:
+    WasmLayoutFixture() : lexer(buffer), module("layoutTest"), parser(module, lexer)
+    {
+        buffer.addBlock("fn cold(x) { x - 1 } fn second(x) { x * 2 } fn first(x) { second(x) + 1 }"
+                        " first(20)");
+        parser.parse();
+        codeGen.dispatch(module);
+    }
+
+protected:
+    vector<string> definedFunctions()
+    {
+        vector<string> names;
+        for (auto& func : static_cast<wasm::Module*>(codeGen.getBinaryenModule())->functions)
+        {
+            if (!func->imported())
+            {
+                names.emplace_back(func->name.str);
+            }
+        }
+        return names;
+    }
+
+    SourceBuffer buffer;
+    Lexer lexer;
+    Module module;
+    Parser parser;
+    WasmCodeGen codeGen;
+};
+
+TEST(WasmLayout, profileRoundTrips)
+{
+    auto filename = "test_wasm_layout_profile.txt";
+    vector<string> firstCalls = {"main", "first", "second"};
+    sk::writeWasmProfile(filename, firstCalls);
+    EXPECT_EQ(firstCalls, sk::readWasmProfile(filename));
+    std::remove(filename);
+}
+
+TEST_F(WasmLayoutFixture, ordersByFirstCall)
+{
+    sk::orderWasmFunctions(codeGen.getBinaryenModule(), {"main", "first", "second"});
+    vector<string> expected = {"main", "first", "second", "cold"};
+    EXPECT_EQ(expected, definedFunctions());
+}
+
+TEST_F(WasmLayoutFixture, splitsColdFunctions)
+{
+    auto coldModule =
+        sk::splitColdWasmFunctions(codeGen.getBinaryenModule(), {"main", "first", "second"});
+    sk::BinaryenModuleRelease coldModuleRelease(coldModule);
+    // cold stays behind as a stub that calls through the table
+    vector<string> expected = {"cold", "second", "first", "main"};
+    EXPECT_EQ(expected, definedFunctions());
+    auto primary = static_cast<wasm::Module*>(codeGen.getBinaryenModule());
+    EXPECT_TRUE(primary->getFunction("cold")->body->is<wasm::CallIndirect>());
+    EXPECT_NE(nullptr, primary->getExportOrNull("table"));
+    EXPECT_NE(nullptr, BinaryenGetFunction(coldModule, "cold"));
+}
+
+TEST_F(WasmLayoutFixture, coldModuleLoadsAfterPrimary)
+{
+    auto coldModule =
+        sk::splitColdWasmFunctions(codeGen.getBinaryenModule(), {"main", "first", "second"});
+    sk::BinaryenModuleRelease coldModuleRelease(coldModule);
+
+    SplitInterface host;
+    wasm::ModuleInstance hot(*static_cast<wasm::Module*>(codeGen.getBinaryenModule()), &host);
+    host.hot = &hot;
+    wasm::LiteralList noArguments;
+    EXPECT_EQ(41, hot.callExport("main", noArguments).geti32());
+    wasm::LiteralList arguments = {wasm::Literal(int32_t(20))};
+    EXPECT_THROW(hot.callFunction("cold", arguments), wasm::TrapException);
+
+    wasm::ModuleInstance cold(*static_cast<wasm::Module*>(coldModule), &host);
+    host.cold = &cold;
+    EXPECT_EQ(19, hot.callFunction("cold", arguments).geti32());
+}
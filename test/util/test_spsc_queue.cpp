@@ -0,0 +1,65 @@
+#include "util/spsc_queue.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+using sk::SpscQueue;
+
+TEST(SpscQueue, roundsCapacityUpToPowerOfTwo)
+{
+    SpscQueue<int> queue(5);
+    EXPECT_EQ(8u, queue.capacity());
+}
+
+TEST(SpscQueue, passesValuesInOrderBetweenThreads)
+{
+    // Far more values than slots, so the producer keeps waiting on the consumer
+    SpscQueue<int> queue(4);
+    std::thread producer([&queue] {
+        for (auto i = 0; i < 100000; ++i)
+        {
+            queue.push(i);
+        }
+    });
+    for (auto i = 0; i < 100000; ++i)
+    {
+        ASSERT_EQ(i, queue.pop());
+    }
+    producer.join();
+}
+
+TEST(SpscQueue, failsPushesOnceClosed)
+{
+    SpscQueue<int> queue(1);
+    EXPECT_TRUE(queue.push(1));
+    queue.close();
+    EXPECT_FALSE(queue.push(2));
+    EXPECT_EQ(1, queue.pop());
+}
+
+TEST(SpscQueue, waitingConsumerSleeps)
+{
+    SpscQueue<int> queue(4);
+    auto startCpu = std::clock();
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        queue.push(1);
+    });
+    EXPECT_EQ(1, queue.pop());
+    producer.join();
+    // A spinning consumer would use most of the producer's sleep
+    EXPECT_LT(double(std::clock() - startCpu) / CLOCKS_PER_SEC, 0.05);
+}
+
+TEST(SpscQueue, closeWakesWaitingProducer)
+{
+    SpscQueue<int> queue(1);
+    EXPECT_TRUE(queue.push(1));
+    std::thread consumer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.close();
+    });
+    EXPECT_FALSE(queue.push(2));
+    consumer.join();
+}
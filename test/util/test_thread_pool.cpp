@@ -0,0 +1,51 @@
+#include "util/thread_pool.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+using sk::ThreadPool;
+using std::atomic;
+using std::vector;
+
+TEST(ThreadPool, runsEveryTask)
+{
+    ThreadPool pool(4);
+    vector<int> results(1000);
+    for (auto i = 0; i < 1000; ++i)
+    {
+        pool.submit([&results, i] { results[i] = i * i; });
+    }
+    pool.wait();
+    for (auto i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(i * i, results[i]);
+    }
+}
+
+TEST(ThreadPool, waitsForNestedTasks)
+{
+    ThreadPool pool(3);
+    atomic<int> count(0);
+    for (auto i = 0; i < 10; ++i)
+    {
+        pool.submit([&pool, &count] {
+            for (auto j = 0; j < 10; ++j)
+            {
+                pool.submit([&count] { ++count; });
+            }
+        });
+    }
+    pool.wait();
+    EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPool, isReusableAfterWait)
+{
+    ThreadPool pool(1);
+    atomic<int> count(0);
+    pool.submit([&count] { ++count; });
+    pool.wait();
+    pool.submit([&count] { ++count; });
+    pool.wait();
+    EXPECT_EQ(2, count);
+}
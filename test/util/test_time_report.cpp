@@ -0,0 +1,79 @@
+#include "util/time_report.hpp"
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+
+using sk::TimePhase;
+using sk::TimeReport;
+
+TEST(TimeReport, recordsPhasesInOrder)
+{
+    TimeReport report("a.sk");
+    {
+        TimePhase phase(&report, "lex");
+        phase.setCount(3, "tokens");
+    }
+    {
+        TimePhase phase(&report, "parse");
+    }
+    auto& phases = report.getPhases();
+    ASSERT_EQ(2u, phases.size());
+    EXPECT_EQ("lex", phases[0].name);
+    EXPECT_EQ(3u, phases[0].count);
+    EXPECT_EQ("tokens", phases[0].countUnit);
+    EXPECT_EQ("parse", phases[1].name);
+    EXPECT_GT(phases[1].peakRssKiB, 0u);
+}
+
+namespace
+{
+size_t fakeAllocatedBytes = 0;
+
+size_t getFakeAllocatedBytes()
+{
+    return fakeAllocatedBytes;
+}
+}
+
+TEST(TimeReport, countsBytesAllocatedInPhase)
+{
+    sk::setAllocatedBytesCounter(getFakeAllocatedBytes);
+    fakeAllocatedBytes = 500;
+    TimeReport report("a.sk");
+    {
+        TimePhase phase(&report, "alloc");
+        fakeAllocatedBytes += 100000;
+    }
+    sk::setAllocatedBytesCounter(nullptr);
+    EXPECT_EQ(100000u, report.getPhases()[0].bytesAllocated);
+}
+
+TEST(TimeReport, reportsNoAllocationsWithoutCounter)
+{
+    TimeReport report("a.sk");
+    {
+        TimePhase phase(&report, "alloc");
+        std::unique_ptr<char[]> buffer(new char[100000]);
+    }
+    EXPECT_EQ(0u, report.getPhases()[0].bytesAllocated);
+}
+
+TEST(TimeReport, printsJson)
+{
+    TimeReport report("dir/\"a\".sk");
+    {
+        TimePhase phase(&report, "read");
+        phase.setCount(10, "bytes");
+    }
+    std::ostringstream os;
+    report.printJson(os);
+    auto json = os.str();
+    EXPECT_EQ(0u, json.find("{\"file\":\"dir/\\\"a\\\".sk\",\"phases\":[{\"name\":\"read\""));
+    EXPECT_NE(std::string::npos, json.find("\"count\":10,\"unit\":\"bytes\"}]}"));
+}
+
+TEST(TimePhase, doesNothingWithoutReport)
+{
+    TimePhase phase(nullptr, "lex");
+    phase.setCount(1, "tokens");
+}
@@ -0,0 +1,53 @@
+#include "util/trace.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using sk::TraceSpan;
+
+namespace
+{
+std::string getTrace()
+{
+    std::ostringstream os;
+    sk::writeTrace(os);
+    return os.str();
+}
+}
+
+TEST(Trace, recordsNothingWhenStopped)
+{
+    sk::startTracing();
+    sk::stopTracing();
+    {
+        TraceSpan span("untraced");
+    }
+    EXPECT_EQ(std::string::npos, getTrace().find("untraced"));
+}
+
+TEST(Trace, writesCompleteEventsWithDetail)
+{
+    sk::startTracing();
+    {
+        TraceSpan span("codegen function", "fib");
+    }
+    sk::stopTracing();
+    auto trace = getTrace();
+    EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, trace.find("{\"name\":\"codegen function\",\"ph\":\"X\""));
+    EXPECT_NE(std::string::npos, trace.find("\"args\":{\"detail\":\"fib\"}"));
+}
+
+TEST(Trace, givesEveryThreadItsOwnTid)
+{
+    sk::startTracing();
+    std::thread first([] { TraceSpan span("first"); });
+    first.join();
+    std::thread second([] { TraceSpan span("second"); });
+    second.join();
+    sk::stopTracing();
+    auto trace = getTrace();
+    EXPECT_NE(std::string::npos, trace.find("\"tid\":1,\"args\":{\"name\":\"thread 1\"}"));
+    EXPECT_NE(std::string::npos, trace.find("\"tid\":2,\"args\":{\"name\":\"thread 2\"}"));
+}